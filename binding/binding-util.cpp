@@ -23,6 +23,7 @@
 
 #include "exception.h"
 #include "sharedstate.h"
+#include "graphics.h"
 #include "src/util/util.h"
 
 #include <assert.h>
@@ -74,6 +75,10 @@ void raiseRbExc(const Exception &exc) {
   rb_raise(excClass, "%s", exc.msg.c_str());
 }
 
+void finalizerLock() { GFX_LOCK; }
+
+void finalizerUnlock() { GFX_UNLOCK; }
+
 void raiseDisposedAccess(VALUE self) {
 #if RAPI_FULL > 187
   const char *klassName = RTYPEDDATA_TYPE(self)->wrap_struct_name;
@@ -190,8 +190,16 @@ template <rb_data_type_t *rbType> static VALUE classAllocate(VALUE klass) {
 }
 #endif
 
+/* Finalizers run whenever the GC does, possibly while the
+ * present thread has the GL context; these take it for the
+ * destructors that free GL resources */
+void finalizerLock();
+void finalizerUnlock();
+
 template <class C> static void freeInstance(void *inst) {
+    finalizerLock();
     delete static_cast<C *>(inst);
+    finalizerUnlock();
 }
 
 void raiseDisposedAccess(VALUE self);
@@ -209,13 +209,33 @@ RB_METHOD(bitmapGetPixel) {
     rb_get_args(argc, argv, "ii", &x, &y RB_ARG_END);
     
     Color value;
-    GUARD_EXC(value = b->getPixel(x, y););
+    GFX_GUARD_EXC(value = b->getPixel(x, y););
     
     Color *color = new Color(value);
     
     return wrapObject(color, ColorType);
 }
 
+RB_METHOD(bitmapPrefetchPixels) {
+    Bitmap *b = getPrivateData<Bitmap>(self);
+    
+    IntRect rect;
+    
+    if (argc == 1) {
+        VALUE rectObj;
+        
+        rb_get_args(argc, argv, "o", &rectObj RB_ARG_END);
+        
+        rect = getPrivateDataCheck<Rect>(rectObj, RectType)->toIntRect();
+    } else {
+        rb_get_args(argc, argv, "iiii", &rect.x, &rect.y, &rect.w, &rect.h RB_ARG_END);
+    }
+    
+    GFX_GUARD_EXC(b->prefetchPixels(rect););
+    
+    return self;
+}
+
 RB_METHOD(bitmapSetPixel) {
     Bitmap *b = getPrivateData<Bitmap>(self);
     
@@ -233,6 +253,78 @@ RB_METHOD(bitmapSetPixel) {
     return self;
 }
 
+RB_METHOD(bitmapGetPixels) {
+    Bitmap *b = getPrivateData<Bitmap>(self);
+    
+    IntRect rect;
+    
+    if (argc == 1) {
+        VALUE rectObj;
+        
+        rb_get_args(argc, argv, "o", &rectObj RB_ARG_END);
+        
+        rect = getPrivateDataCheck<Rect>(rectObj, RectType)->toIntRect();
+    } else {
+        rb_get_args(argc, argv, "iiii", &rect.x, &rect.y, &rect.w, &rect.h RB_ARG_END);
+    }
+    
+    /* Checks the rect before anything is allocated for it */
+    size_t size = 0;
+    GFX_GUARD_EXC(size = b->pixelsSize(rect););
+    
+    VALUE ret = rb_str_new(0, size);
+    
+    GFX_GUARD_EXC(b->getPixels(rect, RSTRING_PTR(ret)););
+    
+    return ret;
+}
+
+RB_METHOD(bitmapSetPixels) {
+    Bitmap *b = getPrivateData<Bitmap>(self);
+    
+    IntRect rect;
+    VALUE str;
+    
+    if (argc == 2) {
+        VALUE rectObj;
+        
+        rb_get_args(argc, argv, "oo", &rectObj, &str RB_ARG_END);
+        
+        rect = getPrivateDataCheck<Rect>(rectObj, RectType)->toIntRect();
+    } else {
+        rb_get_args(argc, argv, "iiiio", &rect.x, &rect.y, &rect.w, &rect.h, &str RB_ARG_END);
+    }
+    
+    SafeStringValue(str);
+    
+    GFX_GUARD_EXC(b->setPixels(rect, RSTRING_PTR(str), RSTRING_LEN(str)););
+    
+    return self;
+}
+
+RB_METHOD(bitmapGetDeferPixels) {
+    RB_UNUSED_PARAM;
+    
+    rb_check_argc(argc, 0);
+    
+    Bitmap *b = getPrivateData<Bitmap>(self);
+    
+    return rb_bool_new(b->getDeferPixels());
+}
+
+RB_METHOD(bitmapSetDeferPixels) {
+    RB_UNUSED_PARAM;
+    
+    bool value;
+    rb_get_args(argc, argv, "b", &value RB_ARG_END);
+    
+    Bitmap *b = getPrivateData<Bitmap>(self);
+    
+    GFX_GUARD_EXC(b->setDeferPixels(value););
+    
+    return rb_bool_new(value);
+}
+
 RB_METHOD(bitmapHueChange) {
     Bitmap *b = getPrivateData<Bitmap>(self);
     
@@ -715,6 +807,33 @@ RB_METHOD(bitmapGetMaxSize){
     return INT2NUM(Bitmap::maxSize());
 }
 
+RB_METHOD(bitmapPreload) {
+    RB_UNUSED_PARAM;
+    
+    /* Takes paths as arguments, in arrays or both */
+    VALUE paths = rb_funcall(rb_ary_new4(argc, argv), rb_intern("flatten"), 0);
+    
+    for (long i = 0; i < RARRAY_LEN(paths); ++i) {
+        VALUE path = rb_ary_entry(paths, i);
+        
+        GUARD_EXC(Bitmap::preload(StringValueCStr(path)););
+    }
+    
+    return Qnil;
+}
+
+RB_METHOD(bitmapClearPreloaded) {
+    RB_UNUSED_PARAM;
+    
+    rb_check_argc(argc, 0);
+    
+    GFX_LOCK;
+    Bitmap::clearPreloaded();
+    GFX_UNLOCK;
+    
+    return Qnil;
+}
+
 RB_METHOD(bitmapInitializeCopy) {
     rb_check_argc(argc, 1);
     VALUE origObj = argv[0];
@@ -758,6 +877,11 @@ void bitmapBindingInit() {
     _rb_define_method(klass, "fill_rect", bitmapFillRect);
     _rb_define_method(klass, "clear", bitmapClear);
     _rb_define_method(klass, "get_pixel", bitmapGetPixel);
+    _rb_define_method(klass, "prefetch_pixels", bitmapPrefetchPixels);
+    _rb_define_method(klass, "get_pixels", bitmapGetPixels);
+    _rb_define_method(klass, "set_pixels", bitmapSetPixels);
+    _rb_define_method(klass, "defer_pixels", bitmapGetDeferPixels);
+    _rb_define_method(klass, "defer_pixels=", bitmapSetDeferPixels);
     _rb_define_method(klass, "set_pixel", bitmapSetPixel);
     _rb_define_method(klass, "hue_change", bitmapHueChange);
     _rb_define_method(klass, "draw_text", bitmapDrawText);
@@ -774,6 +898,8 @@ void bitmapBindingInit() {
     
     _rb_define_method(klass, "mega?", bitmapGetMega);
     rb_define_singleton_method(klass, "max_size", RUBY_METHOD_FUNC(bitmapGetMaxSize), -1);
+    rb_define_singleton_method(klass, "preload", RUBY_METHOD_FUNC(bitmapPreload), -1);
+    rb_define_singleton_method(klass, "clear_preloaded", RUBY_METHOD_FUNC(bitmapClearPreloaded), -1);
     
     _rb_define_method(klass, "animated?", bitmapGetAnimated);
     _rb_define_method(klass, "playing", bitmapGetPlaying);
@@ -63,6 +63,31 @@ RB_METHOD(fontDoesExist) {
   return rb_bool_new(Font::doesExist(name));
 }
 
+RB_METHOD(fontTextCacheStats) {
+  RB_UNUSED_PARAM;
+
+  TextCacheStats stats;
+  shState->fontState().textCacheStats(stats);
+
+  VALUE hash = rb_hash_new();
+
+  rb_hash_aset(hash, ID2SYM(rb_intern("hits")), ULL2NUM(stats.hits));
+  rb_hash_aset(hash, ID2SYM(rb_intern("misses")), ULL2NUM(stats.misses));
+  rb_hash_aset(hash, ID2SYM(rb_intern("entries")), INT2NUM(stats.entries));
+  rb_hash_aset(hash, ID2SYM(rb_intern("bytes")), ULL2NUM(stats.bytes));
+  rb_hash_aset(hash, ID2SYM(rb_intern("budget")), ULL2NUM(stats.budget));
+
+  return hash;
+}
+
+RB_METHOD(fontClearTextCache) {
+  RB_UNUSED_PARAM;
+
+  shState->fontState().clearTextCache();
+
+  return Qnil;
+}
+
 RB_METHOD(FontSetName);
 
 RB_METHOD(fontInitialize) {
@@ -282,6 +307,8 @@ void fontBindingInit() {
   }
 
   rb_define_class_method(klass, "exist?", fontDoesExist);
+  rb_define_class_method(klass, "text_cache_stats", fontTextCacheStats);
+  rb_define_class_method(klass, "clear_text_cache", fontClearTextCache);
 
   _rb_define_method(klass, "initialize", fontInitialize);
   _rb_define_method(klass, "initialize_copy", fontInitializeCopy);
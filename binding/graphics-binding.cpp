@@ -21,11 +21,18 @@
 
 #include "config.h"
 #include "graphics.h"
+#include "frameprofiler.h"
+#include "gpuprofiler.h"
+#include "screencapture.h"
 #include "sharedstate.h"
+#include "scene.h"
+#include "shader.h"
 #include "binding-util.h"
 #include "binding-types.h"
 #include "exception.h"
 
+#include <algorithm>
+
 #if RAPI_MAJOR >= 2
 #include <ruby/thread.h>
 #endif
@@ -38,6 +45,32 @@ RB_METHOD(graphicsDelta) {
     return ret;
 }
 
+/* Runs the blocks of finished Graphics.screenshot_async calls,
+ * and keeps the results of those without one around for
+ * Graphics.screenshot_result */
+static void graphicsDispatchScreenshots(VALUE self)
+{
+    std::vector<CaptureResult> finished;
+    shState->graphics().finishedScreenshots(finished);
+    
+    if (finished.empty())
+        return;
+    
+    VALUE callbacks = rb_iv_get(self, "screenshot_callbacks");
+    VALUE results = rb_iv_get(self, "screenshot_results");
+    
+    for (size_t i = 0; i < finished.size(); ++i) {
+        VALUE id = INT2NUM(finished[i].id);
+        VALUE ok = finished[i].ok ? Qtrue : Qfalse;
+        VALUE callback = rb_hash_delete(callbacks, id);
+        
+        if (NIL_P(callback))
+            rb_hash_aset(results, id, ok);
+        else
+            rb_funcall(callback, rb_intern("call"), 1, ok);
+    }
+}
+
 RB_METHOD(graphicsUpdate)
 {
     RB_UNUSED_PARAM;
@@ -51,6 +84,7 @@ RB_METHOD(graphicsUpdate)
 #else
     shState->graphics().update();
 #endif
+    graphicsDispatchScreenshots(self);
     return Qnil;
 }
 
@@ -63,6 +97,155 @@ RB_METHOD(graphicsAverageFrameRate)
     return ret;
 }
 
+RB_METHOD(graphicsSceneStats)
+{
+    RB_UNUSED_PARAM;
+    
+    GFX_LOCK;
+    const SceneStats stats = shState->sceneStats();
+    GFX_UNLOCK;
+    
+    VALUE hash = rb_hash_new();
+    
+    rb_hash_aset(hash, ID2SYM(rb_intern("drawn")), UINT2NUM(stats.drawn));
+    rb_hash_aset(hash, ID2SYM(rb_intern("culled")), UINT2NUM(stats.culled));
+    rb_hash_aset(hash, ID2SYM(rb_intern("empty")), UINT2NUM(stats.empty));
+    
+    return hash;
+}
+
+RB_METHOD(graphicsSkippedGLCalls)
+{
+    RB_UNUSED_PARAM;
+    
+    VALUE hash = rb_hash_new();
+    
+    rb_hash_aset(hash, ID2SYM(rb_intern("uniforms")), ULONG2NUM(Shader::skippedUniformCount()));
+    rb_hash_aset(hash, ID2SYM(rb_intern("texture_binds")), ULONG2NUM(TEX::skippedBinds));
+    
+    return hash;
+}
+
+RB_METHOD(graphicsFrameStats)
+{
+    RB_UNUSED_PARAM;
+    
+    std::vector<FrameTiming> frames;
+    
+    GFX_LOCK;
+    shState->graphics().frameStats(frames);
+    GFX_UNLOCK;
+    
+    VALUE ary = rb_ary_new2(frames.size());
+    
+    for (size_t i = 0; i < frames.size(); ++i) {
+        const FrameTiming &frame = frames[i];
+        VALUE hash = rb_hash_new();
+        
+        rb_hash_aset(hash, ID2SYM(rb_intern("frame")), INT2NUM(frame.frame));
+        
+        for (int j = 0; j < FrameTiming::PhaseCount; ++j) {
+            const char *name = FrameTiming::phaseName((FrameTiming::Phase) j);
+            rb_hash_aset(hash, ID2SYM(rb_intern(name)), DBL2NUM(frame.phases[j]));
+        }
+        
+        rb_ary_push(ary, hash);
+    }
+    
+    return ary;
+}
+
+RB_METHOD(graphicsGPUStats)
+{
+    RB_UNUSED_PARAM;
+    
+    GPUProfiler &profiler = shState->gpuProfiler();
+    
+    if (!profiler.isSupported())
+        return Qnil;
+    
+    VALUE hash = rb_hash_new();
+    
+    GFX_LOCK;
+    for (int i = 0; i < GPUProfiler::CategoryCount; ++i) {
+        GPUProfiler::Category category = (GPUProfiler::Category) i;
+        rb_hash_aset(hash, ID2SYM(rb_intern(GPUProfiler::categoryName(category))),
+                     DBL2NUM(profiler.average(category)));
+    }
+    
+    rb_hash_aset(hash, ID2SYM(rb_intern("total")), DBL2NUM(profiler.averageTotal()));
+    GFX_UNLOCK;
+    
+    return hash;
+}
+
+RB_METHOD(graphicsBenchmarkViewportEffects)
+{
+    RB_UNUSED_PARAM;
+    
+    int passes = 100;
+    rb_get_args(argc, argv, "|i", &passes RB_ARG_END);
+    
+    GFX_LOCK;
+    const ViewportEffectBenchmark result = shState->graphics().benchmarkViewportEffects(passes);
+    GFX_UNLOCK;
+    
+    VALUE hash = rb_hash_new();
+    
+    rb_hash_aset(hash, ID2SYM(rb_intern("fused_ms")), DBL2NUM(result.fusedMs));
+    rb_hash_aset(hash, ID2SYM(rb_intern("multi_pass_ms")), DBL2NUM(result.multiPassMs));
+    rb_hash_aset(hash, ID2SYM(rb_intern("fused_fill")), ULL2NUM(result.fusedFill));
+    rb_hash_aset(hash, ID2SYM(rb_intern("multi_pass_fill")), ULL2NUM(result.multiPassFill));
+    
+    return hash;
+}
+
+RB_METHOD(graphicsBenchmarkSceneOrder)
+{
+    RB_UNUSED_PARAM;
+    
+    int count = 2000;
+    int frames = 100;
+    rb_get_args(argc, argv, "|ii", &count, &frames RB_ARG_END);
+    
+    GFX_LOCK;
+    const SceneOrderBenchmark result =
+        Scene::benchmarkOrdering(std::max(count, 1), std::max(frames, 1));
+    GFX_UNLOCK;
+    
+    VALUE hash = rb_hash_new();
+    
+    rb_hash_aset(hash, ID2SYM(rb_intern("indexed_ms")), DBL2NUM(result.indexedMs));
+    rb_hash_aset(hash, ID2SYM(rb_intern("linear_ms")), DBL2NUM(result.linearMs));
+    
+    return hash;
+}
+
+RB_METHOD(graphicsPacingStats)
+{
+    RB_UNUSED_PARAM;
+    
+    FramePacingStats stats;
+    
+    GFX_LOCK;
+    shState->graphics().pacingStats(stats);
+    GFX_UNLOCK;
+    
+    VALUE hash = rb_hash_new();
+    
+    rb_hash_aset(hash, ID2SYM(rb_intern("frames")), INT2NUM(stats.frames));
+    rb_hash_aset(hash, ID2SYM(rb_intern("mean")), DBL2NUM(stats.meanMs));
+    rb_hash_aset(hash, ID2SYM(rb_intern("variance")), DBL2NUM(stats.variance));
+    rb_hash_aset(hash, ID2SYM(rb_intern("min")), DBL2NUM(stats.minMs));
+    rb_hash_aset(hash, ID2SYM(rb_intern("max")), DBL2NUM(stats.maxMs));
+    rb_hash_aset(hash, ID2SYM(rb_intern("missed")), INT2NUM(stats.missed));
+    rb_hash_aset(hash, ID2SYM(rb_intern("total_missed")), ULL2NUM(stats.totalMissed));
+    rb_hash_aset(hash, ID2SYM(rb_intern("spin_margin")), DBL2NUM(stats.spinMarginMs));
+    rb_hash_aset(hash, ID2SYM(rb_intern("oversleep")), DBL2NUM(stats.oversleepMs));
+    
+    return hash;
+}
+
 RB_METHOD(graphicsFreeze)
 {
     RB_UNUSED_PARAM;
@@ -359,6 +542,36 @@ RB_METHOD(graphicsScreenshot)
     return Qnil;
 }
 
+RB_METHOD(graphicsScreenshotAsync)
+{
+    RB_UNUSED_PARAM;
+    
+    VALUE filename;
+    rb_scan_args(argc, argv, "1", &filename);
+    SafeStringValue(filename);
+    
+    int id = 0;
+    GFX_GUARD_EXC( id = shState->graphics().screenshotAsync(RSTRING_PTR(filename)); );
+    
+    if (rb_block_given_p())
+        rb_hash_aset(rb_iv_get(self, "screenshot_callbacks"), INT2NUM(id), rb_block_proc());
+    
+    return INT2NUM(id);
+}
+
+/* nil while the capture is still running */
+RB_METHOD(graphicsScreenshotResult)
+{
+    RB_UNUSED_PARAM;
+    
+    int id;
+    rb_get_args(argc, argv, "i", &id RB_ARG_END);
+    
+    graphicsDispatchScreenshots(self);
+    
+    return rb_hash_delete(rb_iv_get(self, "screenshot_results"), INT2NUM(id));
+}
+
 DEF_GRA_PROP_I(FrameRate)
 DEF_GRA_PROP_I(FrameCount)
 DEF_GRA_PROP_I(Brightness)
@@ -390,12 +603,24 @@ void graphicsBindingInit()
     _rb_define_module_function(module, "transition", graphicsTransition);
     _rb_define_module_function(module, "frame_reset", graphicsFrameReset);
     _rb_define_module_function(module, "screenshot", graphicsScreenshot);
+    _rb_define_module_function(module, "screenshot_async", graphicsScreenshotAsync);
+    _rb_define_module_function(module, "screenshot_result", graphicsScreenshotResult);
+    
+    rb_iv_set(module, "screenshot_callbacks", rb_hash_new());
+    rb_iv_set(module, "screenshot_results", rb_hash_new());
     
     _rb_define_module_function(module, "__reset__", graphicsReset);
     
     INIT_GRA_PROP_BIND( FrameRate,  "frame_rate"  );
     INIT_GRA_PROP_BIND( FrameCount, "frame_count" );
     _rb_define_module_function(module, "average_frame_rate", graphicsAverageFrameRate);
+    _rb_define_module_function(module, "scene_stats", graphicsSceneStats);
+    _rb_define_module_function(module, "skipped_gl_calls", graphicsSkippedGLCalls);
+    _rb_define_module_function(module, "frame_stats", graphicsFrameStats);
+    _rb_define_module_function(module, "gpu_stats", graphicsGPUStats);
+    _rb_define_module_function(module, "benchmark_viewport_effects", graphicsBenchmarkViewportEffects);
+    _rb_define_module_function(module, "benchmark_scene_order", graphicsBenchmarkSceneOrder);
+    _rb_define_module_function(module, "pacing_stats", graphicsPacingStats);
 
     _rb_define_module_function(module, "width", graphicsWidth);
     _rb_define_module_function(module, "height", graphicsHeight);
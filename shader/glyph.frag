@@ -0,0 +1,11 @@
+
+uniform sampler2D texture;
+
+varying vec2 v_texCoord;
+varying lowp vec4 v_color;
+
+void main()
+{
+	/* Atlas glyphs are white; only their coverage is used */
+	gl_FragColor = vec4(v_color.rgb, texture2D(texture, v_texCoord).a);
+}
@@ -0,0 +1,25 @@
+
+uniform sampler2D texture;
+
+varying vec2 v_texCoord;
+varying vec2 v_shadowCoord;
+
+void main()
+{
+	vec4 src = texture2D(texture, v_texCoord);
+	float shdA = texture2D(texture, v_shadowCoord).a;
+
+	if (src.a == 1.0 || shdA == 0.0)
+	{
+		gl_FragColor = src;
+		return;
+	}
+
+	/* Blend the text over a black copy of itself offset by one
+	 * pixel, truncating the same way applyShadow() in bitmap.cpp
+	 * does so both paths produce identical pixels */
+	float fa = src.a + shdA * (1.0 - src.a);
+	vec3 rgb = src.rgb * (src.a / fa);
+
+	gl_FragColor = floor(clamp(vec4(rgb, fa), 0.0, 1.0) * 255.0) / 255.0;
+}
@@ -131,8 +131,10 @@ void Config::read(int argc, char *argv[]) {
         {"debugMode", false},
         {"displayFPS", false},
         {"printFPS", false},
+        {"frameTraceFile", ""},
         {"winResizable", false},
         {"fullscreen", false},
+        {"headless", false},
         {"fixedAspectRatio", true},
         {"smoothScaling", 0},
         {"smoothScalingDown", 0},
@@ -153,8 +155,16 @@ void Config::read(int argc, char *argv[]) {
         {"windowTitle", ""},
         {"fixedFramerate", 0},
         {"frameSkip", false},
+        {"preciseFramePacing", false},
+        {"pipelinedRendering", false},
         {"syncToRefreshrate", false},
         {"solidFonts", json::array({})},
+        {"glyphAtlasText", true},
+        {"textCacheSize", 4096},
+        {"imageDecodeThreads", 2},
+        {"imageUploadBudget", 2000},
+        {"imageCacheSize", 65536},
+        {"gifResidentSize", 32768},
 #if defined(__APPLE__) && defined(__aarch64__)
         {"preferMetalRenderer", true},
 #else
@@ -169,6 +179,7 @@ void Config::read(int argc, char *argv[]) {
         {"integerScalingActive", false},
         {"integerScalingLastMile", true},
         {"maxTextureSize", 0},
+        {"shaderCache", true},
         {"gameFolder", ""},
         {"anyAltToggleFS", false},
         {"enableReset", false},
@@ -272,7 +283,14 @@ try { exp } catch (...) {}
     SET_OPT(debugMode, boolean);
     SET_OPT(displayFPS, boolean);
     SET_OPT(printFPS, boolean);
+    SET_STRINGOPT(frameTraceFile, frameTraceFile);
     SET_OPT(fullscreen, boolean);
+    SET_OPT(headless, boolean);
+    
+    for (size_t i = 0; i < launchArgs.size(); i++) {
+        if (launchArgs[i] == "--headless")
+            headless = true;
+    }
     SET_OPT(fixedAspectRatio, boolean);
     SET_OPT(smoothScaling, integer);
     SET_OPT(smoothScalingDown, integer);
@@ -292,11 +310,19 @@ try { exp } catch (...) {}
     SET_STRINGOPT(windowTitle, windowTitle);
     SET_OPT(fixedFramerate, integer);
     SET_OPT(frameSkip, boolean);
+    SET_OPT(preciseFramePacing, boolean);
+    SET_OPT(pipelinedRendering, boolean);
     SET_OPT(syncToRefreshrate, boolean);
     fillStringVec(opts["solidFonts"], solidFonts);
     for (std::string & solidFont : solidFonts)
         std::transform(solidFont.begin(), solidFont.end(), solidFont.begin(),
             [](unsigned char c) { return std::tolower(c); });
+    SET_OPT(glyphAtlasText, boolean);
+    SET_OPT(textCacheSize, integer);
+    SET_OPT(imageDecodeThreads, integer);
+    SET_OPT(imageUploadBudget, integer);
+    SET_OPT(imageCacheSize, integer);
+    SET_OPT(gifResidentSize, integer);
 #ifdef __APPLE__
     SET_OPT(preferMetalRenderer, boolean);
 #endif
@@ -305,6 +331,7 @@ try { exp } catch (...) {}
     SET_OPT_CUSTOMKEY(integerScaling.active, integerScalingActive, boolean);
     SET_OPT_CUSTOMKEY(integerScaling.lastMileScaling, integerScalingLastMile, boolean);
     SET_OPT(maxTextureSize, integer);
+    SET_OPT(shaderCache, boolean);
     SET_OPT(anyAltToggleFS, boolean);
     SET_OPT(enableReset, boolean);
     SET_OPT(enableSettings, boolean);
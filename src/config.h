@@ -39,9 +39,11 @@ struct Config {
     bool preferMetalRenderer;
     bool displayFPS;
     bool printFPS;
+    std::string frameTraceFile;
     
     bool winResizable;
     bool fullscreen;
+    bool headless;
     bool fixedAspectRatio;
     int smoothScaling;
     int smoothScalingDown;
@@ -64,13 +66,23 @@ struct Config {
     
     int fixedFramerate;
     bool frameSkip;
+    bool preciseFramePacing;
+    bool pipelinedRendering;
     bool syncToRefreshrate;
     
     std::vector<std::string> solidFonts;
+    bool glyphAtlasText;
+    int textCacheSize;
+    
+    int imageDecodeThreads;
+    int imageUploadBudget;
+    int imageCacheSize;
+    int gifResidentSize;
     
     bool subImageFix;
     bool enableBlitting;
     int maxTextureSize;
+    bool shaderCache;
     
     struct {
         bool active;
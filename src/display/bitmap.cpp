@@ -36,12 +36,16 @@
 #include "transform.h"
 #include "exception.h"
 
+#include "screencapture.h"
 #include "sharedstate.h"
 #include "glstate.h"
 #include "texpool.h"
 #include "shader.h"
 #include "filesystem.h"
 #include "font.h"
+#include "glyphatlas.h"
+#include "imageloader.h"
+#include "gifstream.h"
 #include "eventthread.h"
 #include "graphics.h"
 #include "system.h"
@@ -53,6 +57,7 @@
 
 #include <math.h>
 #include <algorithm>
+#include <vector>
 
 extern "C" {
 #include "libnsgif/libnsgif.h"
@@ -65,6 +70,16 @@ throw Exception(Exception::MKXPError, \
 "Operation not supported for mega surfaces"); \
 }
 
+/* Edge length of the tiles the client side
+ * copy of a bitmap is read back in */
+#define SHADOW_TILE 64
+
+enum
+{
+    ShadowValid = 0,
+    ShadowInvalid = -1
+};
+
 #define GUARD_ANIMATED \
 { \
 if (p->animation.enabled) \
@@ -164,6 +179,9 @@ struct BitmapPrivate
         bool needsReset;
         bool loop;
         std::vector<TEXFBO> frames;
+        /* Used instead of 'frames' for GIFs too large to keep
+         * entirely on the GPU */
+        GifStream *stream;
         float fps;
         int lastFrame;
         double startTime, playTime;
@@ -173,15 +191,23 @@ struct BitmapPrivate
             return floor(lastFrame + (playTime / (1 / fps)));
         }
         
+        inline int frameCount() {
+            return (stream) ? stream->frameCount() : (int)frames.size();
+        }
+        
         unsigned int currentFrameI() {
             if (!playing || needsReset) return lastFrame;
             int i = currentFrameIRaw();
-            return (loop) ? fmod(i, frames.size()) : (i > (int)frames.size() - 1) ? (int)frames.size() - 1 : i;
+            return (loop) ? fmod(i, frameCount()) : (i > frameCount() - 1) ? frameCount() - 1 : i;
+        }
+        
+        inline TEXFBO &frameAt(int i) {
+            return (stream) ? stream->frame(i) : frames[i];
         }
         
         inline TEXFBO &currentFrame() {
             int i = currentFrameI();
-            return frames[i];
+            return frameAt(i);
         }
         
         inline void play() {
@@ -195,7 +221,7 @@ struct BitmapPrivate
         }
         
         inline void seek(int frame) {
-            lastFrame = clamp(frame, 0, (int)frames.size());
+            lastFrame = clamp(frame, 0, frameCount());
         }
         
         void updateTimer() {
@@ -225,11 +251,41 @@ struct BitmapPrivate
     SDL_Surface *megaSurface;
     
     /* A cached version of the bitmap in client memory, for
-     * getPixel calls. Is invalidated any time the bitmap
-     * is modified */
+     * getPixel calls. It's read back in tiles as they're
+     * needed, and modifying the bitmap only invalidates
+     * the tiles that were touched */
     SDL_Surface *surface;
     SDL_PixelFormat *format;
     
+    struct Prefetch
+    {
+        int id;
+        IntRect rect;
+        GLuint pbo;
+        _GLsync fence;
+    };
+    
+    struct
+    {
+        /* Per tile: ShadowValid, ShadowInvalid, or the
+         * id of the prefetch reading it back */
+        std::vector<int> tiles;
+        int cols;
+        int rows;
+        
+        std::vector<Prefetch> prefetches;
+        int nextPrefetch;
+    } shadow;
+    
+    /* Deferred setPixel: pixels only go into the surface,
+     * and the area they cover is uploaded in one go before
+     * the texture is next used */
+    struct
+    {
+        bool enabled;
+        IntRect dirty;
+    } deferred;
+    
     /* The 'tainted' area describes which parts of the
      * bitmap are not cleared, ie. don't have 0 opacity.
      * If we're blitting / drawing text to a cleared part
@@ -253,11 +309,17 @@ struct BitmapPrivate
     {
         format = SDL_AllocFormat(SDL_PIXELFORMAT_ABGR8888);
         
+        shadow.cols = shadow.rows = 0;
+        shadow.nextPrefetch = 1;
+        
+        deferred.enabled = false;
+        
         animation.width = 0;
         animation.height = 0;
         animation.enabled = false;
         animation.playing = false;
         animation.loop = true;
+        animation.stream = 0;
         animation.playTime = 0;
         animation.startTime = 0;
         animation.fps = 0;
@@ -282,9 +344,30 @@ struct BitmapPrivate
     
     void prepare()
     {
+        flushPixels();
+        
+        if (!shadow.prefetches.empty())
+            resolvePrefetches(0);
+        
         if (!animation.enabled || !animation.playing) return;
         
         animation.updateTimer();
+        
+        if (animation.stream)
+            animation.stream->advance(animation.currentFrameI(), animation.loop);
+    }
+    
+    /* Decodes all frames of a streamed GIF onto the GPU,
+     * for operations that need them all at once */
+    void unstream()
+    {
+        if (!animation.stream)
+            return;
+        
+        animation.stream->decodeAll(animation.frames);
+        
+        delete animation.stream;
+        animation.stream = 0;
     }
     
     void allocSurface()
@@ -292,6 +375,318 @@ struct BitmapPrivate
         surface = SDL_CreateRGBSurface(0, gl.width, gl.height, format->BitsPerPixel,
                                        format->Rmask, format->Gmask,
                                        format->Bmask, format->Amask);
+        
+        if (!surface)
+            throw Exception(Exception::SDLError, "Failed to allocate bitmap surface: %s", SDL_GetError());
+        
+        shadow.cols = (gl.width + SHADOW_TILE - 1) / SHADOW_TILE;
+        shadow.rows = (gl.height + SHADOW_TILE - 1) / SHADOW_TILE;
+        shadow.tiles.assign(shadow.cols * shadow.rows, ShadowInvalid);
+    }
+    
+    void freeSurface()
+    {
+        for (size_t i = 0; i < shadow.prefetches.size(); ++i)
+            deletePrefetch(shadow.prefetches[i]);
+        
+        shadow.prefetches.clear();
+        shadow.tiles.clear();
+        
+        if (surface)
+            SDL_FreeSurface(surface);
+        
+        surface = 0;
+    }
+    
+    /* Range of tiles overlapping 'rect', false if none */
+    bool tileRange(const IntRect &rect, int &c0, int &r0, int &c1, int &r1) const
+    {
+        IntRect norm = normalizedRect(rect);
+        
+        int x0 = std::max(norm.x, 0);
+        int y0 = std::max(norm.y, 0);
+        int x1 = std::min(norm.x + norm.w, gl.width);
+        int y1 = std::min(norm.y + norm.h, gl.height);
+        
+        if (x0 >= x1 || y0 >= y1)
+            return false;
+        
+        c0 = x0 / SHADOW_TILE;
+        r0 = y0 / SHADOW_TILE;
+        c1 = (x1 - 1) / SHADOW_TILE;
+        r1 = (y1 - 1) / SHADOW_TILE;
+        
+        return true;
+    }
+    
+    int &tileAt(int col, int row)
+    {
+        return shadow.tiles[row * shadow.cols + col];
+    }
+    
+    IntRect tileRect(int c0, int r0, int c1, int r1) const
+    {
+        int x = c0 * SHADOW_TILE;
+        int y = r0 * SHADOW_TILE;
+        
+        return IntRect(x, y,
+                       std::min((c1 + 1) * SHADOW_TILE, gl.width) - x,
+                       std::min((r1 + 1) * SHADOW_TILE, gl.height) - y);
+    }
+    
+    /* Bounding box of the tiles in 'rect' that aren't
+     * (being) read back yet, false if there are none */
+    bool invalidTiles(const IntRect &rect, IntRect &box, bool pendingToo)
+    {
+        int c0, r0, c1, r1;
+        
+        if (!tileRange(rect, c0, r0, c1, r1))
+            return false;
+        
+        int bc0 = c1, br0 = r1, bc1 = c0, br1 = r0;
+        bool any = false;
+        
+        for (int r = r0; r <= r1; ++r)
+            for (int c = c0; c <= c1; ++c)
+            {
+                int state = tileAt(c, r);
+                
+                if (state == ShadowValid || (state > 0 && !pendingToo))
+                    continue;
+                
+                bc0 = std::min(bc0, c); br0 = std::min(br0, r);
+                bc1 = std::max(bc1, c); br1 = std::max(br1, r);
+                any = true;
+            }
+        
+        if (any)
+            box = tileRect(bc0, br0, bc1, br1);
+        
+        return any;
+    }
+    
+    bool shadowComplete() const
+    {
+        if (!surface)
+            return false;
+        
+        for (size_t i = 0; i < shadow.tiles.size(); ++i)
+            if (shadow.tiles[i] != ShadowValid)
+                return false;
+        
+        return true;
+    }
+    
+    /* Makes the surface up to date inside 'rect' */
+    void syncShadow(const IntRect &rect)
+    {
+        if (!surface)
+            allocSurface();
+        
+        if (!shadow.prefetches.empty())
+            resolvePrefetches(&rect);
+        
+        IntRect box;
+        
+        if (!invalidTiles(rect, box, true))
+            return;
+        
+        std::vector<uint8_t> pixels(box.w * box.h * 4);
+        
+        FBO::bind(gl.fbo);
+        ::gl.ReadPixels(box.x, box.y, box.w, box.h, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+        
+        storeTiles(box, &pixels[0], 0);
+    }
+    
+    /* Copies the rows of 'box' into the surface, and marks the
+     * tiles inside it valid (only those waiting on 'prefetch'
+     * unless it's 0) */
+    void storeTiles(const IntRect &box, const uint8_t *pixels, int prefetch)
+    {
+        int c0, r0, c1, r1;
+        tileRange(box, c0, r0, c1, r1);
+        
+        for (int r = r0; r <= r1; ++r)
+            for (int c = c0; c <= c1; ++c)
+            {
+                int &state = tileAt(c, r);
+                
+                if (prefetch && state != prefetch)
+                    continue;
+                
+                IntRect tile = tileRect(c, r, c, r);
+                
+                for (int y = tile.y; y < tile.y + tile.h; ++y)
+                {
+                    const uint8_t *src = pixels + ((y - box.y) * box.w + (tile.x - box.x)) * 4;
+                    uint8_t *dst = (uint8_t*) surface->pixels + y * surface->pitch + tile.x * 4;
+                    
+                    memcpy(dst, src, tile.w * 4);
+                }
+                
+                state = ShadowValid;
+            }
+    }
+    
+    void addDeferredPixel(int x, int y)
+    {
+        IntRect &d = deferred.dirty;
+        
+        if (d.w == 0)
+        {
+            d = IntRect(x, y, 1, 1);
+            return;
+        }
+        
+        int x1 = std::max(d.x + d.w, x + 1);
+        int y1 = std::max(d.y + d.h, y + 1);
+        
+        d.x = std::min(d.x, x);
+        d.y = std::min(d.y, y);
+        d.w = x1 - d.x;
+        d.h = y1 - d.y;
+    }
+    
+    /* Uploads the pixels set since the last flush */
+    void flushPixels()
+    {
+        if (deferred.dirty.w == 0)
+            return;
+        
+        IntRect dirty = deferred.dirty;
+        deferred.dirty = IntRect();
+        
+        /* The tiles in between that saw no setPixel
+         * might not have been read back yet */
+        syncShadow(dirty);
+        
+        TEX::bind(gl.tex);
+        GLMeta::subRectImageUpload(surface->w, dirty.x, dirty.y,
+                                   dirty.x, dirty.y, dirty.w, dirty.h,
+                                   surface, GL_RGBA);
+        GLMeta::subRectImageEnd();
+    }
+    
+    void invalidateShadow(const IntRect &rect)
+    {
+        int c0, r0, c1, r1;
+        
+        if (!surface || !tileRange(rect, c0, r0, c1, r1))
+            return;
+        
+        for (int r = r0; r <= r1; ++r)
+            for (int c = c0; c <= c1; ++c)
+                tileAt(c, r) = ShadowInvalid;
+    }
+    
+    /* Starts reading back the invalid tiles inside 'rect'
+     * without waiting for the GPU. Needs pixel buffer objects */
+    void prefetchShadow(const IntRect &rect)
+    {
+        if (!::gl.pixel_pack_buffer || !::gl.MapBufferRange)
+            return;
+        
+        if (!surface)
+            allocSurface();
+        
+        IntRect box;
+        
+        if (!invalidTiles(rect, box, false))
+            return;
+        
+        Prefetch pf;
+        pf.id = shadow.nextPrefetch++;
+        pf.rect = box;
+        
+        ::gl.GenBuffers(1, &pf.pbo);
+        ::gl.BindBuffer(GL_PIXEL_PACK_BUFFER, pf.pbo);
+        ::gl.BufferData(GL_PIXEL_PACK_BUFFER, box.w * box.h * 4, 0, GL_STREAM_READ);
+        
+        FBO::bind(gl.fbo);
+        ::gl.ReadPixels(box.x, box.y, box.w, box.h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        
+        ::gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        
+        pf.fence = ::gl.FenceSync ? ::gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : 0;
+        
+        int c0, r0, c1, r1;
+        tileRange(box, c0, r0, c1, r1);
+        
+        for (int r = r0; r <= r1; ++r)
+            for (int c = c0; c <= c1; ++c)
+                if (tileAt(c, r) == ShadowInvalid)
+                    tileAt(c, r) = pf.id;
+        
+        shadow.prefetches.push_back(pf);
+    }
+    
+    /* Copies finished prefetches into the surface. Those
+     * overlapping 'waitFor' are finished even if the GPU
+     * is not done with them yet */
+    void resolvePrefetches(const IntRect *waitFor)
+    {
+        for (size_t i = 0; i < shadow.prefetches.size();)
+        {
+            Prefetch &pf = shadow.prefetches[i];
+            
+            bool wait = false;
+            
+            if (waitFor)
+            {
+                SDL_Rect a = *waitFor, b = pf.rect;
+                wait = SDL_HasIntersection(&a, &b);
+            }
+            
+            if (!wait && !prefetchDone(pf))
+            {
+                ++i;
+                continue;
+            }
+            
+            const size_t size = pf.rect.w * pf.rect.h * 4;
+            
+            ::gl.BindBuffer(GL_PIXEL_PACK_BUFFER, pf.pbo);
+            
+            const uint8_t *pixels = (const uint8_t*)
+                ::gl.MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+            
+            if (pixels)
+            {
+                storeTiles(pf.rect, pixels, pf.id);
+                ::gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            
+            ::gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            
+            /* Tiles left waiting on it get read back on demand */
+            for (size_t t = 0; t < shadow.tiles.size(); ++t)
+                if (shadow.tiles[t] == pf.id)
+                    shadow.tiles[t] = ShadowInvalid;
+            
+            deletePrefetch(pf);
+            shadow.prefetches.erase(shadow.prefetches.begin() + i);
+        }
+    }
+    
+    bool prefetchDone(const Prefetch &pf) const
+    {
+        /* Without fences, map it at the next prepareDraw
+         * and hope the GPU is done by then */
+        if (!pf.fence)
+            return true;
+        
+        GLenum status = ::gl.ClientWaitSync(pf.fence, 0, 0);
+        
+        return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+    }
+    
+    void deletePrefetch(Prefetch &pf)
+    {
+        if (pf.fence)
+            ::gl.DeleteSync(pf.fence);
+        
+        ::gl.DeleteBuffers(1, &pf.pbo);
     }
     
     void clearTaintedArea()
@@ -412,13 +807,52 @@ struct BitmapPrivate
         surf = surfConv;
     }
     
-    void onModified(bool freeSurface = true)
+    /* Gives the bitmap its own copy of textures it shares with
+     * the image cache or other bitmaps, before drawing to them */
+    void unshare()
     {
-        if (surface && freeSurface)
+        if (animation.enabled)
         {
-            SDL_FreeSurface(surface);
-            surface = 0;
+            for (TEXFBO &frame : animation.frames)
+                unshareTex(frame);
+        }
+        else
+        {
+            unshareTex(gl);
         }
+    }
+    
+    static void unshareTex(TEXFBO &tex)
+    {
+        TexPool &pool = shState->texPool();
+        
+        if (!pool.isShared(tex))
+            return;
+        
+        TEXFBO copy = pool.request(tex.width, tex.height);
+        copy.selfHires = tex.selfHires;
+        
+        GLMeta::blitBegin(copy);
+        GLMeta::blitSource(tex);
+        GLMeta::blitRectangle(IntRect(0, 0, tex.width, tex.height), Vec2i());
+        GLMeta::blitEnd();
+        
+        pool.release(tex);
+        tex = copy;
+    }
+    
+    void onModified(bool freeShadow = true)
+    {
+        if (freeShadow)
+            freeSurface();
+        
+        self->modified();
+    }
+    
+    /* Only 'rect' changed */
+    void onModified(const IntRect &rect)
+    {
+        invalidateShadow(rect);
         
         self->modified();
     }
@@ -491,6 +925,54 @@ struct BitmapOpenHandler : FileSystem::OpenHandler
     }
 };
 
+void decodeImage(const char *path, DecodedImage &out)
+{
+    BitmapOpenHandler handler;
+    
+    try
+    {
+        shState->fileSystem().openRead(handler, path, &out.path);
+    }
+    catch (const Exception &e)
+    {
+        out.thrown = true;
+        out.excType = e.type;
+        out.excMsg = e.msg;
+        return;
+    }
+    
+    out.surface = handler.surface;
+    out.gif = handler.gif;
+    out.gifData = handler.gif_data;
+    out.gifDataSize = handler.gif_data_size;
+    out.error = handler.error;
+    
+    if (!out.error.empty())
+        return;
+    
+    BitmapPrivate::ensureFormat(out.surface, SDL_PIXELFORMAT_ABGR8888);
+    
+    if (!out.gif && !out.surface)
+        out.error = SDL_GetError();
+}
+
+void Bitmap::preload(const char *filename)
+{
+    std::string hiresPrefix = "Hires/";
+    std::string filenameStd = filename;
+    
+    // Bitmap(const char*) looks for this one first
+    if (shState->config().enableHires && filenameStd.compare(0, hiresPrefix.size(), hiresPrefix) != 0)
+        shState->imageLoader().preload(hiresPrefix + filenameStd);
+    
+    shState->imageLoader().preload(filenameStd);
+}
+
+void Bitmap::clearPreloaded()
+{
+    shState->imageLoader().clear();
+}
+
 Bitmap::Bitmap(const char *filename)
 {
     std::string hiresPrefix = "Hires/";
@@ -511,83 +993,121 @@ Bitmap::Bitmap(const char *filename)
         }
     }
 
-    BitmapOpenHandler handler;
-    shState->fileSystem().openRead(handler, filename);
+    ImageLoader &loader = shState->imageLoader();
+    
+    std::string cacheKey;
     
-    if (!handler.error.empty()) {
-        // Not loaded with SDL, but I want it to be caught with the same exception type
-        throw Exception(Exception::SDLError, "Error loading image '%s': %s", filename, handler.error.c_str());
+    if (!hiresBitmap)
+        cacheKey = loader.textureKey(filename);
+    
+    TEXFBO cached;
+    
+    if (loader.findTexture(cacheKey, cached))
+    {
+        /* Loaded from this file before; share the texture */
+        DecodedImage unused;
+        
+        if (loader.take(filename, unused))
+            unused.release();
+        
+        p = new BitmapPrivate(this);
+        p->gl = cached;
+        p->addTaintedArea(rect());
+        return;
     }
-    else if (!handler.gif && !handler.surface) {
-        throw Exception(Exception::SDLError, "Error loading image '%s': %s",
-                        filename, SDL_GetError());
+    
+    DecodedImage image;
+    
+    if (!loader.take(filename, image))
+        decodeImage(filename, image);
+    
+    if (image.thrown)
+        throw Exception(image.excType, "%s", image.excMsg.c_str());
+    
+    if (!image.error.empty()) {
+        // Not always loaded with SDL, but I want it to be caught with the same exception type
+        throw Exception(Exception::SDLError, "Error loading image '%s': %s", filename, image.error.c_str());
     }
     
-    if (handler.gif) {
+    /* Keyed on the file that was actually read */
+    if (!hiresBitmap)
+        cacheKey = loader.recordTextureKey(filename, image.path);
+    
+    if (image.gif) {
         p = new BitmapPrivate(this);
 
         p->selfHires = hiresBitmap;
         
-        if (handler.gif->width >= (uint32_t)glState.caps.maxTexSize || handler.gif->height > (uint32_t)glState.caps.maxTexSize)
+        if (image.gif->width >= (uint32_t)glState.caps.maxTexSize || image.gif->height > (uint32_t)glState.caps.maxTexSize)
         {
             throw new Exception(Exception::MKXPError, "Animation too large (%ix%i, max %ix%i)",
-                                handler.gif->width, handler.gif->height, glState.caps.maxTexSize, glState.caps.maxTexSize);
+                                image.gif->width, image.gif->height, glState.caps.maxTexSize, glState.caps.maxTexSize);
         }
         
-        if (handler.gif->frame_count == 1) {
+        if (image.gif->frame_count == 1) {
             TEXFBO texfbo;
             try {
-                texfbo = shState->texPool().request(handler.gif->width, handler.gif->height);
+                texfbo = shState->texPool().request(image.gif->width, image.gif->height);
             }
             catch (const Exception &e)
             {
-                gif_finalise(handler.gif);
-                delete handler.gif;
-                delete handler.gif_data;
+                gif_finalise(image.gif);
+                delete image.gif;
+                delete image.gifData;
                 
                 throw e;
             }
             
             TEX::bind(texfbo.tex);
-            TEX::uploadImage(handler.gif->width, handler.gif->height, handler.gif->frame_image, GL_RGBA);
-            gif_finalise(handler.gif);
-            delete handler.gif;
-            delete handler.gif_data;
+            TEX::uploadImage(image.gif->width, image.gif->height, image.gif->frame_image, GL_RGBA);
+            gif_finalise(image.gif);
+            delete image.gif;
+            delete image.gifData;
             
             p->gl = texfbo;
             if (p->selfHires != nullptr) {
                 p->gl.selfHires = &p->selfHires->getGLTypes();
             }
             p->addTaintedArea(rect());
+            loader.cacheTexture(cacheKey, p->gl);
             return;
         }
         
         p->animation.enabled = true;
-        p->animation.width = handler.gif->width;
-        p->animation.height = handler.gif->height;
+        p->animation.width = image.gif->width;
+        p->animation.height = image.gif->height;
         
         // Guess framerate based on the first frame's delay
-        p->animation.fps = 1 / ((float)handler.gif->frames[handler.gif->decoded_frame].frame_delay / 100);
+        p->animation.fps = 1 / ((float)image.gif->frames[image.gif->decoded_frame].frame_delay / 100);
         if (p->animation.fps < 0) p->animation.fps = shState->graphics().getFrameRate();
         
         // Loop gif (Either it's looping or it's not, at the moment)
-        p->animation.loop = handler.gif->loop_count >= 0;
+        p->animation.loop = image.gif->loop_count >= 0;
         
-        int fcount = handler.gif->frame_count;
-        int fcount_partial = handler.gif->frame_count_partial;
+        int fcount = image.gif->frame_count;
+        int fcount_partial = image.gif->frame_count_partial;
         if (fcount > fcount_partial) {
             Debug() << "Non-fatal error reading" << filename << ": Only decoded" << fcount_partial << "out of" << fcount << "frames";
         }
+        
+        // Too large to upload every frame; decode them as they're shown
+        size_t animBytes = (size_t)p->animation.width * p->animation.height * 4 * fcount_partial;
+        if (animBytes > (size_t)std::max(shState->config().gifResidentSize, 0) * 1024) {
+            p->animation.stream = new GifStream(image.gif, image.gifData, image.gifDataSize, fcount_partial);
+            p->addTaintedArea(rect());
+            return;
+        }
+        
         for (int i = 0; i < fcount_partial; i++) {
             if (i > 0) {
-                int status = gif_decode_frame(handler.gif, i);
+                int status = gif_decode_frame(image.gif, i);
                 if (status != GIF_OK && status != GIF_WORKING) {
                     for (TEXFBO &frame : p->animation.frames)
                         shState->texPool().release(frame);
                     
-                    gif_finalise(handler.gif);
-                    delete handler.gif;
-                    delete handler.gif_data;
+                    gif_finalise(image.gif);
+                    delete image.gif;
+                    delete image.gifData;
                     
                     throw Exception(Exception::MKXPError, "Failed to decode GIF frame %i out of %i (Status %i)",
                                     i + 1, fcount_partial, status);
@@ -603,28 +1123,48 @@ Bitmap::Bitmap(const char *filename)
                 for (TEXFBO &frame : p->animation.frames)
                     shState->texPool().release(frame);
                 
-                gif_finalise(handler.gif);
-                delete handler.gif;
-                delete handler.gif_data;
+                gif_finalise(image.gif);
+                delete image.gif;
+                delete image.gifData;
                 
                 throw e;
             }
             
             TEX::bind(texfbo.tex);
-            TEX::uploadImage(p->animation.width, p->animation.height, handler.gif->frame_image, GL_RGBA);
+            TEX::uploadImage(p->animation.width, p->animation.height, image.gif->frame_image, GL_RGBA);
             p->animation.frames.push_back(texfbo);
         }
         
-        gif_finalise(handler.gif);
-        delete handler.gif;
-        delete handler.gif_data;
+        gif_finalise(image.gif);
+        delete image.gif;
+        delete image.gifData;
         p->addTaintedArea(rect());
         return;
     }
 
-    SDL_Surface *imgSurf = handler.surface;
+    if (image.tex.tex != TEX::ID(0))
+    {
+        /* Uploaded while preloading */
+        SDL_FreeSurface(image.surface);
+        
+        p = new BitmapPrivate(this);
+        p->selfHires = hiresBitmap;
+        p->gl = image.tex;
+        if (p->selfHires != nullptr) {
+            p->gl.selfHires = &p->selfHires->getGLTypes();
+        }
+        
+        p->addTaintedArea(rect());
+        loader.cacheTexture(cacheKey, p->gl);
+        return;
+    }
+    
+    SDL_Surface *imgSurf = image.surface;
 
     initFromSurface(imgSurf, hiresBitmap, false);
+    
+    if (!p->megaSurface)
+        loader.cacheTexture(cacheKey, p->gl);
 }
 
 Bitmap::Bitmap(int width, int height, bool isHires)
@@ -714,21 +1254,22 @@ Bitmap::Bitmap(const Bitmap &other, int frame)
 
     p = new BitmapPrivate(this);
     
+    /* The copy shares the textures of 'other' until
+     * either of them is drawn to (see unshare()) */
+    TexPool &pool = shState->texPool();
+    
     // TODO: Clean me up
     if (!other.isAnimated() || frame >= -1) {
-        p->gl = shState->texPool().request(other.width(), other.height());
-        
-        GLMeta::blitBegin(p->gl);
-        // Blit just the current frame of the other animated bitmap
+        // Take just the current frame of the other animated bitmap
         if (!other.isAnimated() || frame == -1) {
-            GLMeta::blitSource(other.getGLTypes());
+            p->gl = other.getGLTypes();
         }
         else {
-            auto &frames = other.getFrames();
-            GLMeta::blitSource(frames[clamp(frame, 0, (int)frames.size() - 1)]);
+            p->gl = other.p->animation.frameAt(clamp(frame, 0, other.p->animation.frameCount() - 1));
         }
-        GLMeta::blitRectangle(rect(), rect(), true);
-        GLMeta::blitEnd();
+        
+        p->gl.selfHires = nullptr;
+        pool.retain(p->gl);
     }
     else {
         p->animation.enabled = true;
@@ -740,21 +1281,15 @@ Bitmap::Bitmap(const Bitmap &other, int frame)
         p->animation.startTime = 0;
         p->animation.loop = other.getLooping();
         
-        for (TEXFBO &sourceframe : other.getFrames()) {
-            TEXFBO newframe;
-            try {
-                newframe = shState->texPool().request(p->animation.width, p->animation.height);
-            } catch(const Exception &e) {
-                for (TEXFBO &f : p->animation.frames)
-                    shState->texPool().release(f);
-                throw e;
-            }
-            
-            GLMeta::blitBegin(newframe);
-            GLMeta::blitSource(sourceframe);
-            GLMeta::blitRectangle(rect(), rect(), true);
-            GLMeta::blitEnd();
+        if (other.p->animation.stream) {
+            p->animation.stream = other.p->animation.stream->clone();
+        }
+        
+        for (TEXFBO &sourceframe : other.p->animation.frames) {
+            TEXFBO newframe = sourceframe;
+            newframe.selfHires = nullptr;
             
+            pool.retain(newframe);
             p->animation.frames.push_back(newframe);
         }
     }
@@ -1013,6 +1548,9 @@ void Bitmap::stretchBlt(IntRect destRect,
                         int opacity, bool smooth)
 {
     guardDisposed();
+    
+    p->flushPixels();
+    p->unshare();
 
     // Don't need this, right? This function is fine with megasurfaces it seems
     //GUARD_MEGA;
@@ -1283,7 +1821,7 @@ void Bitmap::stretchBlt(IntRect destRect,
         SDL_FreeSurface(blitTemp);
     
     p->addTaintedArea(destRect);
-    p->onModified();
+    p->onModified(destRect);
 }
 
 void Bitmap::fillRect(int x, int y,
@@ -1297,9 +1835,13 @@ void Bitmap::fillRect(const IntRect &rect, const Vec4 &color)
 {
     guardDisposed();
     
+    p->flushPixels();
+    
     GUARD_MEGA;
     GUARD_ANIMATED;
     
+    p->unshare();
+    
     if (hasHires()) {
         int destX, destY, destWidth, destHeight;
         destX = rect.x * p->selfHires->width() / width();
@@ -1319,7 +1861,7 @@ void Bitmap::fillRect(const IntRect &rect, const Vec4 &color)
     /* Fill op */
         p->addTaintedArea(rect);
     
-    p->onModified();
+    p->onModified(rect);
 }
 
 void Bitmap::gradientFillRect(int x, int y,
@@ -1336,9 +1878,13 @@ void Bitmap::gradientFillRect(const IntRect &rect,
 {
     guardDisposed();
     
+    p->flushPixels();
+    
     GUARD_MEGA;
     GUARD_ANIMATED;
     
+    p->unshare();
+    
     if (hasHires()) {
         int destX, destY, destWidth, destHeight;
         destX = rect.x * p->selfHires->width() / width();
@@ -1381,7 +1927,7 @@ void Bitmap::gradientFillRect(const IntRect &rect,
     
     p->addTaintedArea(rect);
     
-    p->onModified();
+    p->onModified(rect);
 }
 
 void Bitmap::clearRect(int x, int y, int width, int height)
@@ -1393,9 +1939,13 @@ void Bitmap::clearRect(const IntRect &rect)
 {
     guardDisposed();
     
+    p->flushPixels();
+    
     GUARD_MEGA;
     GUARD_ANIMATED;
     
+    p->unshare();
+    
     if (hasHires()) {
         int destX, destY, destWidth, destHeight;
         destX = rect.x * p->selfHires->width() / width();
@@ -1408,16 +1958,20 @@ void Bitmap::clearRect(const IntRect &rect)
 
     p->fillRect(rect, Vec4());
     
-    p->onModified();
+    p->onModified(rect);
 }
 
 void Bitmap::blur()
 {
     guardDisposed();
     
+    p->flushPixels();
+    
     GUARD_MEGA;
     GUARD_ANIMATED;
     
+    p->unshare();
+    
     if (hasHires()) {
         p->selfHires->blur();
     }
@@ -1467,9 +2021,13 @@ void Bitmap::radialBlur(int angle, int divisions)
 {
     guardDisposed();
     
+    p->flushPixels();
+    
     GUARD_MEGA;
     GUARD_ANIMATED;
     
+    p->unshare();
+    
     if (hasHires()) {
         p->selfHires->radialBlur(angle, divisions);
         return;
@@ -1568,9 +2126,13 @@ void Bitmap::clear()
 {
     guardDisposed();
     
+    p->flushPixels();
+    
     GUARD_MEGA;
     GUARD_ANIMATED;
     
+    p->unshare();
+    
     if (hasHires()) {
         p->selfHires->clear();
     }
@@ -1649,18 +2211,7 @@ Color Bitmap::getPixel(int x, int y) const
     if (x < 0 || y < 0 || x >= width() || y >= height())
         return Vec4();
 
-    if (!p->surface)
-    {
-        p->allocSurface();
-        
-        FBO::bind(p->gl.fbo);
-        
-        glState.viewport.pushSet(IntRect(0, 0, width(), height()));
-        
-        gl.ReadPixels(0, 0, width(), height(), GL_RGBA, GL_UNSIGNED_BYTE, p->surface->pixels);
-        
-        glState.viewport.pop();
-    }
+    p->syncShadow(IntRect(x, y, 1, 1));
     
     uint32_t pixel = getPixelAt(p->surface, p->format, x, y);
     
@@ -1670,6 +2221,19 @@ Color Bitmap::getPixel(int x, int y) const
                  (pixel >> p->format->Ashift) & 0xFF);
 }
 
+void Bitmap::prefetchPixels(const IntRect &rect)
+{
+    guardDisposed();
+    
+    GUARD_MEGA;
+    GUARD_ANIMATED;
+    
+    if (hasHires())
+        return;
+    
+    p->prefetchShadow(rect);
+}
+
 void Bitmap::setPixel(int x, int y, const Color &color)
 {
     guardDisposed();
@@ -1677,6 +2241,8 @@ void Bitmap::setPixel(int x, int y, const Color &color)
     GUARD_MEGA;
     GUARD_ANIMATED;
     
+    p->unshare();
+    
     if (hasHires()) {
         Debug() << "GAME BUG: Game is calling setPixel on low-res Bitmap; you may want to patch the game to improve graphics quality.";
 
@@ -1703,6 +2269,23 @@ void Bitmap::setPixel(int x, int y, const Color &color)
         (uint8_t) clamp<double>(color.alpha, 0, 255)
     };
     
+    if (p->deferred.enabled)
+    {
+        if (x < 0 || y < 0 || x >= width() || y >= height())
+            return;
+        
+        p->syncShadow(IntRect(x, y, 1, 1));
+        
+        uint32_t &surfPixel = getPixelAt(p->surface, p->format, x, y);
+        surfPixel = SDL_MapRGBA(p->format, pixel[0], pixel[1], pixel[2], pixel[3]);
+        
+        p->addDeferredPixel(x, y);
+        p->addTaintedArea(IntRect(x, y, 1, 1));
+        p->onModified(false);
+        
+        return;
+    }
+    
     TEX::bind(p->gl.tex);
     TEX::uploadSubImage(x, y, 1, 1, &pixel, GL_RGBA);
     
@@ -1711,26 +2294,133 @@ void Bitmap::setPixel(int x, int y, const Color &color)
     /* Setting just a single pixel is no reason to throw away the
      * whole cached surface; we can just apply the same change */
     
+    if (p->surface && x >= 0 && y >= 0 && x < width() && y < height())
+    {
+        int &tile = p->tileAt(x / SHADOW_TILE, y / SHADOW_TILE);
+        
+        if (tile == ShadowValid)
+        {
+            uint32_t &surfPixel = getPixelAt(p->surface, p->format, x, y);
+            surfPixel = SDL_MapRGBA(p->format, pixel[0], pixel[1], pixel[2], pixel[3]);
+        }
+        else
+        {
+            /* A prefetch in flight would bring back the old value */
+            tile = ShadowInvalid;
+        }
+    }
+    
+    p->onModified(false);
+}
+
+size_t Bitmap::pixelsSize(const IntRect &rect) const
+{
+    guardDisposed();
+    
+    /* Written so that nothing can overflow */
+    if (rect.x < 0 || rect.y < 0 || rect.w <= 0 || rect.h <= 0 ||
+        rect.w > width() - rect.x || rect.h > height() - rect.y)
+        throw Exception(Exception::MKXPError, "Rect (%d, %d, %d, %d) is outside of the bitmap",
+                        rect.x, rect.y, rect.w, rect.h);
+    
+    return (size_t) rect.w * rect.h * 4;
+}
+
+void Bitmap::getPixels(const IntRect &rect, void *output)
+{
+    guardDisposed();
+    
+    GUARD_MEGA;
+    GUARD_ANIMATED;
+    
+    if (hasHires()) {
+        Debug() << "GAME BUG: Game is calling getPixels on low-res Bitmap; you may want to patch the game to improve graphics quality.";
+    }
+    
+    pixelsSize(rect);
+    
+    const size_t pitch = (size_t) rect.w * 4;
+    
+    p->syncShadow(rect);
+    
+    for (int y = 0; y < rect.h; ++y)
+        memcpy((uint8_t*) output + y * pitch,
+               &getPixelAt(p->surface, p->format, rect.x, rect.y + y), pitch);
+}
+
+void Bitmap::setPixels(const IntRect &rect, const void *data, size_t size)
+{
+    guardDisposed();
+    
+    GUARD_MEGA;
+    GUARD_ANIMATED;
+    
+    if (hasHires()) {
+        Debug() << "GAME BUG: Game is calling setPixels on low-res Bitmap; you may want to patch the game to improve graphics quality.";
+    }
+    
+    const size_t expected = pixelsSize(rect);
+    const size_t pitch = (size_t) rect.w * 4;
+    
+    if (size != expected)
+        throw Exception(Exception::MKXPError, "Expected %llu bytes of pixel data, got %llu",
+                        (unsigned long long) expected, (unsigned long long) size);
+    
+    p->flushPixels();
+    p->unshare();
+    
+    TEX::bind(p->gl.tex);
+    TEX::uploadSubImage(rect.x, rect.y, rect.w, rect.h, data, GL_RGBA);
+    
+    p->addTaintedArea(rect);
+    
+    /* Keep the cached tiles that are there current */
     if (p->surface)
     {
-        uint32_t &surfPixel = getPixelAt(p->surface, p->format, x, y);
-        surfPixel = SDL_MapRGBA(p->format, pixel[0], pixel[1], pixel[2], pixel[3]);
+        for (int y = 0; y < rect.h; ++y)
+            memcpy(&getPixelAt(p->surface, p->format, rect.x, rect.y + y),
+                   (const uint8_t*) data + y * pitch, pitch);
+        
+        int c0, r0, c1, r1;
+        p->tileRange(rect, c0, r0, c1, r1);
+        
+        for (int r = r0; r <= r1; ++r)
+            for (int c = c0; c <= c1; ++c)
+                if (p->tileAt(c, r) != ShadowValid)
+                    p->tileAt(c, r) = ShadowInvalid;
     }
     
     p->onModified(false);
 }
 
+bool Bitmap::getDeferPixels() const
+{
+    return p->deferred.enabled;
+}
+
+void Bitmap::setDeferPixels(bool value)
+{
+    guardDisposed();
+    
+    if (!value)
+        p->flushPixels();
+    
+    p->deferred.enabled = value;
+}
+
 bool Bitmap::getRaw(void *output, int output_size)
 {
     if (output_size != width()*height()*4) return false;
     
     guardDisposed();
     
+    p->flushPixels();
+    
     if (hasHires()) {
         Debug() << "GAME BUG: Game is calling getRaw on low-res Bitmap; you may want to patch the game to improve graphics quality.";
     }
 
-    if (!p->animation.enabled && (p->surface || p->megaSurface)) {
+    if (!p->animation.enabled && (p->shadowComplete() || p->megaSurface)) {
         void *src = (p->megaSurface) ? p->megaSurface->pixels : p->surface->pixels;
         memcpy(output, src, output_size);
     }
@@ -1745,8 +2435,12 @@ void Bitmap::replaceRaw(void *pixel_data, int size)
 {
     guardDisposed();
     
+    p->flushPixels();
+    
     GUARD_MEGA;
     
+    p->unshare();
+    
     if (hasHires()) {
         Debug() << "GAME BUG: Game is calling replaceRaw on low-res Bitmap; you may want to patch the game to improve graphics quality.";
     }
@@ -1775,8 +2469,8 @@ void Bitmap::saveToFile(const char *filename)
 
     SDL_Surface *surf;
     
-    if (p->surface || p->megaSurface) {
-        surf = (p->surface) ? p->surface : p->megaSurface;
+    if (p->shadowComplete() || p->megaSurface) {
+        surf = (p->megaSurface) ? p->megaSurface : p->surface;
     }
     else {
         surf = SDL_CreateRGBSurface(0, width(), height(),p->format->BitsPerPixel, p->format->Rmask,p->format->Gmask,p->format->Bmask,p->format->Amask);
@@ -1787,51 +2481,26 @@ void Bitmap::saveToFile(const char *filename)
         getRaw(surf->pixels, surf->w * surf->h * 4);
     }
     
-    // Try and determine the intended image format from the filename extension
-    const char *period = strrchr(filename, '.');
-    int filetype = 0;
-    if (period) {
-        period++;
-        std::string ext;
-        for (int i = 0; i < (int)strlen(period); i++) {
-            ext += tolower(period[i]);
-        }
-        
-        if (!ext.compare("png")) {
-            filetype = 1;
-        }
-        else if (!ext.compare("jpg") || !ext.compare("jpeg")) {
-            filetype = 2;
-        }
-    }
-    
     std::string fn_normalized = shState->fileSystem().normalize(filename, 1, 1);
-    int rc;
-    switch (filetype) {
-        case 2:
-            rc = IMG_SaveJPG(surf, fn_normalized.c_str(), 90);
-            break;
-        case 1:
-            rc = IMG_SavePNG(surf, fn_normalized.c_str());
-            break;
-        case 0: default:
-            rc = SDL_SaveBMP(surf, fn_normalized.c_str());
-            break;
-    }
+    bool ok = saveSurfaceToFile(surf, fn_normalized.c_str());
     
-    if (!p->surface && !p->megaSurface)
+    if (surf != p->surface && surf != p->megaSurface)
         SDL_FreeSurface(surf);
     
-    if (rc) throw Exception(Exception::SDLError, "%s", SDL_GetError());
+    if (!ok) throw Exception(Exception::SDLError, "%s", SDL_GetError());
 }
 
 void Bitmap::hueChange(int hue)
 {
     guardDisposed();
     
+    p->flushPixels();
+    
     GUARD_MEGA;
     GUARD_ANIMATED;
     
+    p->unshare();
+    
     if (hasHires()) {
         p->selfHires->hueChange(hue);
         return;
@@ -1978,6 +2647,247 @@ static void applyShadow(SDL_Surface *&in, const SDL_PixelFormat &fm, const SDL_C
     in = out;
 }
 
+/* Identifies 'str' drawn (kind 'd') or measured (kind 's') with
+ * the current state of 'font'. The TTF_Font handle stands for the
+ * font file and size, as SharedFontState never closes those */
+static std::string textCacheKey(char kind, Font &font, TTF_Font *ttf,
+                                int outlineSize, const char *str)
+{
+    char head[128];
+    
+    if (kind == 's')
+    {
+        snprintf(head, sizeof(head), "s%p:%d:%d|", (void*) ttf,
+                 TTF_GetFontStyle(ttf), font.getItalic());
+    }
+    else
+    {
+        const Color &c = font.getColor();
+        const Color &oc = font.getOutColor();
+        
+        snprintf(head, sizeof(head), "d%p:%d:%d:%d:%d:%d,%d,%d:%d,%d,%d|",
+                 (void*) ttf, TTF_GetFontStyle(ttf), font.isSolid(),
+                 font.getShadow(), outlineSize,
+                 (int) c.getRed(), (int) c.getGreen(), (int) c.getBlue(),
+                 outlineSize ? (int) oc.getRed() : 0,
+                 outlineSize ? (int) oc.getGreen() : 0,
+                 outlineSize ? (int) oc.getBlue() : 0);
+    }
+    
+    return std::string(head) + str;
+}
+
+/* Places the rendered text 'txt' in 'rect', squeezing it
+ * horizontally if it doesn't fit */
+static void blitText(Bitmap &dest, const IntRect &rect, const Bitmap &txt,
+                     int rawTxtH, int align, int opacity)
+{
+    const int txtW = txt.width();
+    const int txtH = txt.height();
+    
+    int alignX = rect.x;
+    
+    switch (align)
+    {
+        default:
+        case Bitmap::Left :
+            break;
+            
+        case Bitmap::Center :
+            alignX += (rect.w - txtW) / 2;
+            break;
+            
+        case Bitmap::Right :
+            alignX += rect.w - txtW;
+            break;
+    }
+    
+    if (alignX < rect.x)
+        alignX = rect.x;
+    
+    int alignY = rect.y + (rect.h - rawTxtH) / 2;
+    
+    float squeeze = (float) rect.w / txtW;
+    
+    if (squeeze > 1)
+        squeeze = 1;
+    
+    IntRect destRect(alignX, alignY, 0, 0);
+    destRect.w = std::min(rect.w, (int)(txtW * squeeze));
+    destRect.h = std::min(rect.h, txtH);
+    
+    destRect.w = std::min(destRect.w, dest.width() - destRect.x);
+    destRect.h = std::min(destRect.h, dest.height() - destRect.y);
+    
+    IntRect sourceRect;
+    sourceRect.w = destRect.w / squeeze;
+    sourceRect.h = destRect.h;
+    
+    bool smooth = squeeze != 1.0f;
+    dest.stretchBlt(destRect, txt, sourceRect, opacity, smooth);
+}
+
+/* Clears 'area' of the bound framebuffer to transparent 'color',
+ * which is what SDL_ttf fills the background of its surfaces with */
+static void clearTextBackground(const IntRect &area, const Vec4 &color)
+{
+    glState.scissorTest.pushSet(true);
+    glState.scissorBox.pushSet(area);
+    glState.clearColor.pushSet(Vec4(color.x, color.y, color.z, 0));
+    
+    FBO::clear();
+    
+    glState.clearColor.pop();
+    glState.scissorBox.pop();
+    glState.scissorTest.pop();
+}
+
+/* Draws 'run' into 'target' in 'color', with the shadow applyShadow()
+ * would add done in a shader ('target' is one pixel larger then) */
+static void drawTextLayer(const TEXFBO &target, const GlyphRun &run,
+                          const Vec4 &color, bool shadow)
+{
+    GlyphAtlas &atlas = shState->glyphAtlas();
+    
+    if (!shadow)
+    {
+        FBO::bind(target.fbo);
+        glState.viewport.pushSet(IntRect(0, 0, target.width, target.height));
+        
+        clearTextBackground(IntRect(0, 0, target.width, target.height), color);
+        atlas.draw(run, Vec2i(), color);
+        
+        glState.viewport.pop();
+        
+        return;
+    }
+    
+    /* The glyphs get a fully transparent border, so the
+     * shadow pass can read one pixel past them on every side */
+    TEXFBO glyphs = shState->texPool().request(run.width + 2, run.height + 2);
+    
+    FBO::bind(glyphs.fbo);
+    glState.viewport.pushSet(IntRect(0, 0, glyphs.width, glyphs.height));
+    
+    glState.clearColor.pushSet(Vec4());
+    FBO::clear();
+    glState.clearColor.pop();
+    
+    clearTextBackground(IntRect(1, 1, run.width, run.height), color);
+    atlas.draw(run, Vec2i(1, 1), color);
+    
+    glState.viewport.pop();
+    
+    FBO::bind(target.fbo);
+    glState.viewport.pushSet(IntRect(0, 0, target.width, target.height));
+    
+    TextShadowShader &shader = shState->shaders().textShadow;
+    shader.bind();
+    shader.applyViewportProj();
+    shader.setTranslation(Vec2i());
+    shader.setTexSize(Vec2i(glyphs.width, glyphs.height));
+    
+    TEX::bind(glyphs.tex);
+    
+    Quad &quad = shState->gpQuad();
+    quad.setTexPosRect(IntRect(1, 1, target.width, target.height),
+                       IntRect(0, 0, target.width, target.height));
+    
+    glState.blend.pushSet(false);
+    quad.draw();
+    glState.blend.pop();
+    
+    glState.viewport.pop();
+    
+    shState->texPool().release(glyphs);
+}
+
+/* Draws text from the glyph atlas, with the same result as the
+ * SDL_ttf path in Bitmap::drawText. Returns false if the atlas
+ * can't reproduce 'str' exactly */
+static bool drawGlyphText(Bitmap &dest, const IntRect &rect, const char *str,
+                          int align, Font &font, int outlineSize)
+{
+    GlyphAtlas &atlas = shState->glyphAtlas();
+    TTF_Font *ttf = font.getSdlFont();
+    const int maxSize = glState.caps.maxTexSize;
+    
+    GlyphRun run;
+    
+    if (!atlas.layout(ttf, str, 0, run))
+        return false;
+    
+    const bool shadow = font.getShadow();
+    const int txtW = run.width + (shadow ? 1 : 0);
+    const int txtH = run.height + (shadow ? 1 : 0);
+    
+    /* Leave anything that needs a mega surface to SDL_ttf */
+    if (run.width + 2 > maxSize || run.height + 2 > maxSize)
+        return false;
+    
+    const Color &fontColor = font.getColor();
+    
+    if (outlineSize == 0)
+    {
+        Bitmap txtBitmap(txtW, txtH, true);
+        drawTextLayer(txtBitmap.getGLTypes(), run, fontColor.norm, shadow);
+        blitText(dest, rect, txtBitmap, run.height, align, fontColor.alpha);
+        
+        return true;
+    }
+    
+    TEXFBO layer = shState->texPool().request(txtW, txtH);
+    drawTextLayer(layer, run, fontColor.norm, shadow);
+    
+    GlyphRun outlineRun;
+    
+    if (!atlas.layout(ttf, str, outlineSize, outlineRun) ||
+        outlineRun.width > maxSize || outlineRun.height > maxSize)
+    {
+        shState->texPool().release(layer);
+        return false;
+    }
+    
+    const Vec4 &outColor = font.getOutColor().norm;
+    
+    Bitmap txtBitmap(outlineRun.width, outlineRun.height, true);
+    const TEXFBO &target = txtBitmap.getGLTypes();
+    
+    FBO::bind(target.fbo);
+    glState.viewport.pushSet(IntRect(0, 0, target.width, target.height));
+    
+    clearTextBackground(IntRect(0, 0, target.width, target.height), outColor);
+    atlas.draw(outlineRun, Vec2i(), outColor);
+    
+    /* Blend the text over its outline, as SDL_BlitSurface does */
+    SimpleShader &shader = shState->shaders().simple;
+    shader.bind();
+    shader.applyViewportProj();
+    shader.setTranslation(Vec2i());
+    shader.setTexSize(Vec2i(layer.width, layer.height));
+    
+    TEX::bind(layer.tex);
+    
+    Quad &quad = shState->gpQuad();
+    quad.setTexPosRect(IntRect(0, 0, txtW, txtH),
+                       IntRect(outlineSize, outlineSize, txtW, txtH));
+    quad.setColor(Vec4(1, 1, 1, 1));
+    
+    glState.blendMode.pushSet(BlendNormal);
+    glState.blend.pushSet(true);
+    quad.draw();
+    glState.blend.pop();
+    glState.blendMode.pop();
+    
+    glState.viewport.pop();
+    
+    shState->texPool().release(layer);
+    
+    blitText(dest, rect, txtBitmap, run.height, align, fontColor.alpha);
+    
+    return true;
+}
+
 void Bitmap::drawText(const IntRect &rect, const char *str, int align)
 {
     guardDisposed();
@@ -1985,6 +2895,8 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
     GUARD_MEGA;
     GUARD_ANIMATED;
     
+    p->unshare();
+    
     if (hasHires()) {
         Font &loresFont = getFont();
         Font &hiresFont = p->selfHires->getFont();
@@ -2020,11 +2932,43 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
     const Color &fontColor = p->font->getColor();
     const Color &outColor = p->font->getOutColor();
     
+    int scaledOutlineSize = 0;
+    
+    if (p->font->getOutline())
+    {
+        scaledOutlineSize = OUTLINE_SIZE;
+        // Handle high-res for outline.
+        if (p->selfLores) {
+            scaledOutlineSize = scaledOutlineSize * width() / p->selfLores->width();
+        }
+    }
+    
+    if (shState->config().glyphAtlasText && !p->font->isSolid() &&
+        drawGlyphText(*this, rect, str, align, *p->font, scaledOutlineSize))
+        return;
+    
+    SharedFontState &fontState = shState->fontState();
+    std::string cacheKey = textCacheKey('d', *p->font, font, scaledOutlineSize, str);
+    
+    int rawTxtSurfH;
+    SDL_Surface *txtSurf = fontState.findText(cacheKey, rawTxtSurfH);
+    
+    if (txtSurf)
+    {
+        txtSurf = SDL_DuplicateSurface(txtSurf);
+        
+        if (!txtSurf)
+            throw Exception(Exception::SDLError, "Failed to copy text surface: %s", SDL_GetError());
+        
+        Bitmap txtBitmap(txtSurf, nullptr, true);
+        blitText(*this, rect, txtBitmap, rawTxtSurfH, align, fontColor.alpha);
+        
+        return;
+    }
+    
     SDL_Color c = fontColor.toSDLColor();
     c.a = 255;
     
-    SDL_Surface *txtSurf;
-    
     if (p->font->isSolid())
         txtSurf = TTF_RenderUTF8_Solid(font, str, c);
     else
@@ -2035,7 +2979,7 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
     
     p->ensureFormat(txtSurf, SDL_PIXELFORMAT_ABGR8888);
     
-    int rawTxtSurfH = txtSurf->h;
+    rawTxtSurfH = txtSurf->h;
     
     if (p->font->getShadow())
         applyShadow(txtSurf, *p->format, c);
@@ -2047,11 +2991,6 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
         SDL_Color co = outColor.toSDLColor();
         co.a = 255;
         SDL_Surface *outline;
-        // Handle high-res for outline.
-        int scaledOutlineSize = OUTLINE_SIZE;
-        if (p->selfLores) {
-            scaledOutlineSize = scaledOutlineSize * width() / p->selfLores->width();
-        }
         /* set the next font render to render the outline */
         TTF_SetFontOutline(font, scaledOutlineSize);
         if (p->font->isSolid())
@@ -2073,47 +3012,10 @@ void Bitmap::drawText(const IntRect &rect, const char *str, int align)
         TTF_SetFontOutline(font, 0);
     }
     
-    int alignX = rect.x;
-    
-    switch (align)
-    {
-        default:
-        case Left :
-            break;
-            
-        case Center :
-            alignX += (rect.w - txtSurf->w) / 2;
-            break;
-            
-        case Right :
-            alignX += rect.w - txtSurf->w;
-            break;
-    }
-    
-    if (alignX < rect.x)
-        alignX = rect.x;
-    
-    int alignY = rect.y + (rect.h - rawTxtSurfH) / 2;
-    
-    float squeeze = (float) rect.w / txtSurf->w;
-    
-    if (squeeze > 1)
-        squeeze = 1;
-    
-    IntRect destRect(alignX, alignY, 0, 0);
-    destRect.w = std::min(rect.w, (int)(txtSurf->w * squeeze));
-    destRect.h = std::min(rect.h, txtSurf->h);
-    
-    destRect.w = std::min(destRect.w, width() - destRect.x);
-    destRect.h = std::min(destRect.h, height() - destRect.y);
-    
-    IntRect sourceRect;
-    sourceRect.w = destRect.w / squeeze;
-    sourceRect.h = destRect.h;
+    fontState.cacheText(cacheKey, txtSurf, rawTxtSurfH);
     
     Bitmap txtBitmap(txtSurf, nullptr, true);
-    bool smooth = squeeze != 1.0f;
-    stretchBlt(destRect, txtBitmap, sourceRect, fontColor.alpha, smooth);
+    blitText(*this, rect, txtBitmap, rawTxtSurfH, align, fontColor.alpha);
 }
 
 /* http://www.lemoda.net/c/utf8-to-ucs2/index.html */
@@ -2175,6 +3077,14 @@ IntRect Bitmap::textSize(const char *str)
     std::string fixed = fixupString(str);
     str = fixed.c_str();
     
+    SharedFontState &fontState = shState->fontState();
+    std::string cacheKey = textCacheKey('s', *p->font, font, 0, str);
+    
+    IntRect size;
+    
+    if (fontState.findTextSize(cacheKey, size))
+        return size;
+    
     int w, h;
     TTF_SizeUTF8(font, str, &w, &h);
     
@@ -2187,7 +3097,10 @@ IntRect Bitmap::textSize(const char *str)
     if (p->font->getItalic() && *endPtr == '\0')
         TTF_GlyphMetrics(font, ucs2, 0, 0, 0, 0, &w);
     
-    return IntRect(0, 0, w, h);
+    size = IntRect(0, 0, w, h);
+    fontState.cacheTextSize(cacheKey, size);
+    
+    return size;
 }
 
 DEF_ATTR_RD_SIMPLE(Bitmap, Font, Font&, *p->font)
@@ -2212,6 +3125,8 @@ void Bitmap::setInitFont(Font *value)
 
 TEXFBO &Bitmap::getGLTypes() const
 {
+    p->flushPixels();
+    
     return p->getGLTypes();
 }
 
@@ -2221,7 +3136,8 @@ SDL_Surface *Bitmap::surface() const
         Debug() << "BUG: High-res Bitmap surface not implemented";
     }
 
-    return p->surface;
+    /* Only if it's all there */
+    return p->shadowComplete() ? p->surface : 0;
 }
 
 SDL_Surface *Bitmap::megaSurface() const
@@ -2304,7 +3220,7 @@ bool Bitmap::isPlaying() const
     if (p->animation.loop)
         return true;
     
-    return p->animation.currentFrameIRaw() < p->animation.frames.size();
+    return p->animation.currentFrameIRaw() < (unsigned int)p->animation.frameCount();
 }
 
 void Bitmap::gotoAndStop(int frame)
@@ -2344,7 +3260,7 @@ int Bitmap::numFrames() const
     }
 
     if (!p->animation.enabled) return 1;
-    return (int)p->animation.frames.size();
+    return p->animation.frameCount();
 }
 
 int Bitmap::currentFrameI() const
@@ -2365,6 +3281,8 @@ int Bitmap::addFrame(Bitmap &source, int position)
     
     GUARD_MEGA;
     
+    p->unstream();
+    
     if (hasHires()) {
         Debug() << "BUG: High-res Bitmap addFrame dest not implemented";
     }
@@ -2393,16 +3311,14 @@ int Bitmap::addFrame(Bitmap &source, int position)
         
         p->animation.frames.push_back(p->gl);
         
-        if (p->surface)
-            SDL_FreeSurface(p->surface);
+        p->freeSurface();
         p->gl = TEXFBO();
     }
     
     if (source.surface()) {
         TEX::bind(newframe.tex);
         TEX::uploadImage(source.width(), source.height(), source.surface()->pixels, GL_RGBA);
-        SDL_FreeSurface(p->surface);
-        p->surface = 0;
+        p->freeSurface();
     }
     else {
         GLMeta::blitBegin(newframe);
@@ -2430,6 +3346,8 @@ void Bitmap::removeFrame(int position) {
     
     GUARD_UNANIMATED;
     
+    p->unstream();
+    
     if (hasHires()) {
         Debug() << "BUG: High-res Bitmap removeFrame not implemented";
     }
@@ -2466,7 +3384,7 @@ void Bitmap::nextFrame()
     }
 
     stop();
-    if ((uint32_t)p->animation.lastFrame >= p->animation.frames.size() - 1)  {
+    if (p->animation.lastFrame >= p->animation.frameCount() - 1)  {
         if (!p->animation.loop) return;
         p->animation.lastFrame = 0;
         return;
@@ -2491,7 +3409,7 @@ void Bitmap::previousFrame()
             p->animation.lastFrame = 0;
             return;
         }
-        p->animation.lastFrame = (int)p->animation.frames.size() - 1;
+        p->animation.lastFrame = p->animation.frameCount() - 1;
         return;
     }
     
@@ -2520,6 +3438,8 @@ std::vector<TEXFBO> &Bitmap::getFrames() const
         Debug() << "BUG: High-res Bitmap getFrames not implemented";
     }
 
+    p->unstream();
+    
     return p->animation.frames;
 }
 
@@ -2566,6 +3486,7 @@ void Bitmap::bindTex(ShaderBase &shader, bool substituteLoresSize)
 {
     // Hires mode is handled by p->bindTexture.
 
+    p->flushPixels();
     p->bindTexture(shader, substituteLoresSize);
 }
 
@@ -2599,6 +3520,8 @@ void Bitmap::releaseResources()
         delete p->selfHires;
     }
 
+    p->freeSurface();
+    
     if (p->megaSurface)
         SDL_FreeSurface(p->megaSurface);
     else if (p->animation.enabled) {
@@ -2606,6 +3529,7 @@ void Bitmap::releaseResources()
         p->animation.playing = false;
         for (TEXFBO &tex : p->animation.frames)
             shState->texPool().release(tex);
+        delete p->animation.stream;
     }
     else
         shState->texPool().release(p->gl);
@@ -93,7 +93,25 @@ public:
 	void clear();
 
 	Color getPixel(int x, int y) const;
+	
+	/* Starts reading 'rect' back for getPixel
+	 * without waiting for the GPU */
+	void prefetchPixels(const IntRect &rect);
 	void setPixel(int x, int y, const Color &color);
+	
+	/* Tightly packed RGBA rows of 'rect', which has
+	 * to lie within the bitmap */
+	void getPixels(const IntRect &rect, void *output);
+	void setPixels(const IntRect &rect, const void *data, size_t size);
+	
+	/* Size in bytes of the data above; throws if
+	 * 'rect' doesn't lie within the bitmap */
+	size_t pixelsSize(const IntRect &rect) const;
+	
+	/* setPixel only changes the client side copy, and the
+	 * area covered is uploaded in one go before the next
+	 * draw or other operation */
+	DECL_ATTR(DeferPixels, bool)
     
     bool getRaw(void *output, int output_size);
     void replaceRaw(void *pixel_data, int size);
@@ -167,6 +185,11 @@ public:
 
 	static int maxSize();
 
+	/* Starts decoding 'filename' in the background, to
+	 * be picked up by Bitmap(const char*) later */
+	static void preload(const char *filename);
+	static void clearPreloaded();
+
     void assumeRubyGC();
 
 private:
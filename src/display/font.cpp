@@ -34,12 +34,14 @@
 #include <utility>
 #include <algorithm>
 #include <cctype>
+#include <list>
 
 #ifdef MKXPZ_BUILD_XCODE
 #include "filesystem/filesystem.h"
 #endif
 
 #include <SDL_ttf.h>
+#include <SDL_surface.h>
 
 #ifndef MKXPZ_BUILD_XCODE
 #ifndef MKXPZ_CJK_FONT
@@ -92,6 +94,21 @@ struct FontSet
 	std::string other;
 };
 
+struct TextCacheEntry
+{
+	std::string key;
+
+	/* Null for measured sizes */
+	SDL_Surface *surf;
+	int rawHeight;
+
+	IntRect size;
+
+	size_t bytes;
+};
+
+typedef std::list<TextCacheEntry> TextCacheList;
+
 struct SharedFontStatePrivate
 {
 	/* Maps: font family name, To: substituted family name,
@@ -109,12 +126,75 @@ struct SharedFontStatePrivate
     /* Internal default font family that is used anytime an
      * empty/invalid family is requested */
     std::string defaultFamily;
+
+	/* Most recently used first */
+	TextCacheList textCache;
+	BoostHash<std::string, TextCacheList::iterator> textIndex;
+
+	size_t textBytes;
+	size_t textBudget;
+
+	uint64_t textHits;
+	uint64_t textMisses;
+
+	TextCacheEntry *findText(const std::string &key)
+	{
+		if (!textIndex.contains(key))
+		{
+			++textMisses;
+			return 0;
+		}
+
+		++textHits;
+
+		TextCacheList::iterator iter = textIndex[key];
+		textCache.splice(textCache.begin(), textCache, iter);
+
+		return &*iter;
+	}
+
+	void insertText(const TextCacheEntry &entry)
+	{
+		textCache.push_front(entry);
+		textIndex.insert(entry.key, textCache.begin());
+		textBytes += entry.bytes;
+
+		while (textBytes > textBudget)
+			dropText(--textCache.end());
+	}
+
+	void dropText(TextCacheList::iterator iter)
+	{
+		if (iter->surf)
+			SDL_FreeSurface(iter->surf);
+
+		textBytes -= iter->bytes;
+		textIndex.remove(iter->key);
+		textCache.erase(iter);
+	}
+
+	/* Whether an entry of 'bytes' can be kept at all */
+	bool textFits(size_t bytes) const
+	{
+		return bytes <= textBudget;
+	}
 };
 
+static size_t textEntryBytes(const std::string &key)
+{
+	/* Rough bookkeeping overhead of the list and index nodes */
+	return sizeof(TextCacheEntry) + key.size() * 2 + 64;
+}
+
 SharedFontState::SharedFontState(const Config &conf)
 {
 	p = new SharedFontStatePrivate;
 
+	p->textBytes = 0;
+	p->textBudget = (size_t) std::max(conf.textCacheSize, 0) * 1024;
+	p->textHits = 0;
+	p->textMisses = 0;
+
 	/* Parse font substitutions */
 	for (size_t i = 0; i < conf.fontSubs.size(); ++i)
 	{
@@ -137,6 +217,8 @@ SharedFontState::~SharedFontState()
 	for (iter = p->pool.cbegin(); iter != p->pool.cend(); ++iter)
 		TTF_CloseFont(iter->second);
 
+	clearTextCache();
+
 	delete p;
 }
 
@@ -251,6 +333,78 @@ void SharedFontState::setDefaultFontFamily(const std::string &family) {
     p->defaultFamily = family;
 }
 
+SDL_Surface *SharedFontState::findText(const std::string &key, int &rawHeight)
+{
+	TextCacheEntry *entry = p->findText(key);
+
+	if (!entry)
+		return 0;
+
+	rawHeight = entry->rawHeight;
+
+	return entry->surf;
+}
+
+void SharedFontState::cacheText(const std::string &key, SDL_Surface *surf, int rawHeight)
+{
+	TextCacheEntry entry;
+	entry.key = key;
+	entry.rawHeight = rawHeight;
+	entry.bytes = textEntryBytes(key) + surf->pitch * surf->h;
+
+	if (!p->textFits(entry.bytes) || p->textIndex.contains(key))
+		return;
+
+	entry.surf = SDL_DuplicateSurface(surf);
+
+	if (!entry.surf)
+		return;
+
+	p->insertText(entry);
+}
+
+bool SharedFontState::findTextSize(const std::string &key, IntRect &size)
+{
+	TextCacheEntry *entry = p->findText(key);
+
+	if (!entry)
+		return false;
+
+	size = entry->size;
+
+	return true;
+}
+
+void SharedFontState::cacheTextSize(const std::string &key, const IntRect &size)
+{
+	TextCacheEntry entry;
+	entry.key = key;
+	entry.surf = 0;
+	entry.rawHeight = 0;
+	entry.size = size;
+	entry.bytes = textEntryBytes(key);
+
+	if (!p->textFits(entry.bytes) || p->textIndex.contains(key))
+		return;
+
+	p->insertText(entry);
+}
+
+void SharedFontState::textCacheStats(TextCacheStats &out) const
+{
+	out.hits = p->textHits;
+	out.misses = p->textMisses;
+	out.entries = p->textCache.size();
+	out.bytes = p->textBytes;
+	out.budget = p->textBudget;
+}
+
+void SharedFontState::clearTextCache()
+{
+	while (!p->textCache.empty())
+		p->dropText(p->textCache.begin());
+}
+
 void pickExistingFontName(const std::vector<std::string> &names,
                           std::string &out,
                           const SharedFontState &sfs)
@@ -27,13 +27,24 @@
 
 #include <vector>
 #include <string>
+#include <stdint.h>
 
 struct SDL_RWops;
+struct SDL_Surface;
 struct _TTF_Font;
 struct Config;
 
 struct SharedFontStatePrivate;
 
+struct TextCacheStats
+{
+	uint64_t hits;
+	uint64_t misses;
+	int entries;
+	size_t bytes;
+	size_t budget;
+};
+
 class SharedFontState
 {
 public:
@@ -55,6 +66,21 @@ public:
 	static _TTF_Font *openBundled(int size);
     void setDefaultFontFamily(const std::string &family);
 
+	/* Least recently used cache of strings rendered by
+	 * Bitmap::drawText and of measured text sizes, bounded
+	 * by the "textCacheSize" config. 'key' has to identify
+	 * the font state and string completely. Surfaces returned
+	 * by findText() belong to the cache and stay valid until
+	 * the next cacheText() call; cacheText() stores a copy */
+	SDL_Surface *findText(const std::string &key, int &rawHeight);
+	void cacheText(const std::string &key, SDL_Surface *surf, int rawHeight);
+
+	bool findTextSize(const std::string &key, IntRect &size);
+	void cacheTextSize(const std::string &key, const IntRect &size);
+
+	void textCacheStats(TextCacheStats &out) const;
+	void clearTextCache();
+
 private:
 	SharedFontStatePrivate *p;
 };
@@ -0,0 +1,181 @@
+/*
+** frameprofiler.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "frameprofiler.h"
+
+#include "config.h"
+#include "debugwriter.h"
+
+#include <SDL_timer.h>
+
+#include <string.h>
+
+/* Frames kept for Graphics.frame_stats */
+static const size_t historySize = 120;
+
+static const char *phaseNames[] =
+{
+	"ruby",
+	"prepare_draw",
+	"composite",
+	"effects",
+	"blit",
+	"limiter",
+	"swap"
+};
+
+const char *FrameTiming::phaseName(Phase phase)
+{
+	return phaseNames[phase];
+}
+
+FrameProfiler::FrameProfiler(const Config &conf)
+    : frames(historySize),
+      next(0),
+      recorded(0),
+      frameStart(0),
+      lastFrameEnd(0),
+      inFrame(false),
+      tickFreq(SDL_GetPerformanceFrequency()),
+      traceFile(0),
+      traceOrigin(SDL_GetPerformanceCounter()),
+      traceFirstEvent(true)
+{
+	memset(&current, 0, sizeof(current));
+	memset(phaseStart, 0, sizeof(phaseStart));
+
+	if (conf.frameTraceFile.empty())
+		return;
+
+	traceFile = fopen(conf.frameTraceFile.c_str(), "w");
+
+	if (!traceFile)
+	{
+		Debug() << "Could not open frame trace file" << conf.frameTraceFile;
+		return;
+	}
+
+	fputs("[\n", traceFile);
+}
+
+FrameProfiler::~FrameProfiler()
+{
+	if (!traceFile)
+		return;
+
+	fputs("\n]\n", traceFile);
+	fclose(traceFile);
+}
+
+double FrameProfiler::toMs(uint64_t ticks) const
+{
+	return (double) ticks * 1000.0 / tickFreq;
+}
+
+void FrameProfiler::traceEvent(const char *name, uint64_t start, uint64_t end, int frame)
+{
+	if (!traceFile)
+		return;
+
+	/* Complete ("X") events, timestamps in microseconds */
+	fprintf(traceFile, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+	        "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%d}}",
+	        traceFirstEvent ? "" : ",\n", name,
+	        toMs(start - traceOrigin) * 1000.0, toMs(end - start) * 1000.0, frame);
+
+	traceFirstEvent = false;
+}
+
+void FrameProfiler::beginFrame(int frame)
+{
+	uint64_t now = SDL_GetPerformanceCounter();
+
+	memset(&current, 0, sizeof(current));
+	memset(phaseStart, 0, sizeof(phaseStart));
+	current.frame = frame;
+
+	/* Everything since the last update returned was script time */
+	if (lastFrameEnd)
+	{
+		current.phases[FrameTiming::Ruby] = toMs(now - lastFrameEnd);
+		traceEvent(phaseNames[FrameTiming::Ruby], lastFrameEnd, now, frame);
+	}
+
+	frameStart = now;
+	inFrame = true;
+}
+
+void FrameProfiler::endFrame()
+{
+	if (!inFrame)
+		return;
+
+	uint64_t now = SDL_GetPerformanceCounter();
+
+	/* Effect passes run inside of Scene::composite */
+	current.phases[FrameTiming::Composite] -= current.phases[FrameTiming::Effects];
+
+	frames[next] = current;
+	next = (next + 1) % frames.size();
+
+	if (recorded < frames.size())
+		++recorded;
+
+	traceEvent("frame", frameStart, now, current.frame);
+
+	if (traceFile)
+		fflush(traceFile);
+
+	lastFrameEnd = now;
+	inFrame = false;
+}
+
+void FrameProfiler::begin(FrameTiming::Phase phase)
+{
+	if (!inFrame)
+		return;
+
+	phaseStart[phase] = SDL_GetPerformanceCounter();
+}
+
+void FrameProfiler::end(FrameTiming::Phase phase)
+{
+	if (!inFrame || !phaseStart[phase])
+		return;
+
+	uint64_t now = SDL_GetPerformanceCounter();
+
+	current.phases[phase] += toMs(now - phaseStart[phase]);
+	traceEvent(phaseNames[phase], phaseStart[phase], now, current.frame);
+
+	phaseStart[phase] = 0;
+}
+
+void FrameProfiler::history(std::vector<FrameTiming> &out) const
+{
+	out.clear();
+	out.reserve(recorded);
+
+	size_t first = (next + frames.size() - recorded) % frames.size();
+
+	for (size_t i = 0; i < recorded; ++i)
+		out.push_back(frames[(first + i) % frames.size()]);
+}
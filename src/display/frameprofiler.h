@@ -0,0 +1,92 @@
+/*
+** frameprofiler.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+struct Config;
+
+/* CPU time spent in each stage of one Graphics.update, in milliseconds */
+struct FrameTiming
+{
+	enum Phase
+	{
+		Ruby = 0,    /* Scripts running since the previous update */
+		PrepareDraw, /* prepareDraw signal handlers */
+		Composite,   /* Scene::composite, minus viewport effects */
+		Effects,     /* Viewport tone/color/flash passes */
+		Blit,        /* Scaling the screen into the window */
+		Limiter,     /* FPS limiter sleep */
+		Swap,        /* SDL_GL_SwapWindow */
+
+		PhaseCount
+	};
+
+	int frame;
+	double phases[PhaseCount];
+
+	static const char *phaseName(Phase phase);
+};
+
+/* Records a FrameTiming for each of the last frames, and optionally
+ * streams every phase to a Chrome/Perfetto trace file ("frameTraceFile").
+ * Phases reported outside of beginFrame()/endFrame() are ignored. */
+class FrameProfiler
+{
+public:
+	FrameProfiler(const Config &conf);
+	~FrameProfiler();
+
+	void beginFrame(int frame);
+	void endFrame();
+
+	void begin(FrameTiming::Phase phase);
+	void end(FrameTiming::Phase phase);
+
+	/* Fills 'out' with the recorded frames, oldest first */
+	void history(std::vector<FrameTiming> &out) const;
+
+private:
+	double toMs(uint64_t ticks) const;
+	void traceEvent(const char *name, uint64_t start, uint64_t end, int frame);
+
+	std::vector<FrameTiming> frames;
+	size_t next;
+	size_t recorded;
+
+	FrameTiming current;
+	uint64_t phaseStart[FrameTiming::PhaseCount];
+	uint64_t frameStart;
+	uint64_t lastFrameEnd;
+	bool inFrame;
+
+	const uint64_t tickFreq;
+
+	FILE *traceFile;
+	uint64_t traceOrigin;
+	bool traceFirstEvent;
+};
+
+#endif // FRAMEPROFILER_H
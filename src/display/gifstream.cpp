@@ -0,0 +1,388 @@
+/*
+** gifstream.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gifstream.h"
+
+#include "sharedstate.h"
+#include "imageloader.h"
+#include "texpool.h"
+#include "exception.h"
+#include "debugwriter.h"
+
+extern "C" {
+#include "libnsgif/libnsgif.h"
+}
+
+#include <SDL_mutex.h>
+
+#include <string.h>
+
+/* Frames decoded ahead of the one on screen */
+static const int decodeAhead = 4;
+
+/* The frame on screen, the next one and the one before */
+static const int textureRing = 3;
+
+GifStream::GifStream(gif_animation *gif, unsigned char *data, size_t dataSize, int frameCount)
+    : width(gif->width),
+      height(gif->height),
+      frames(frameCount),
+      gifMutex(SDL_CreateMutex()),
+      gif(gif),
+      data(data),
+      dataSize(dataSize),
+      useCounter(0),
+      mutex(SDL_CreateMutex()),
+      buffers(decodeAhead),
+      shown(0),
+      loop(true),
+      failed(false),
+      started(false)
+{
+	/* frame() hands out references into it */
+	textures.reserve(textureRing);
+
+	for (size_t i = 0; i < buffers.size(); ++i)
+	{
+		buffers[i].frame = -1;
+		buffers[i].ready = false;
+	}
+}
+
+GifStream::~GifStream()
+{
+	shState->imageLoader().cancelStream(this);
+
+	for (size_t i = 0; i < textures.size(); ++i)
+		shState->texPool().release(textures[i].tex);
+
+	gif_finalise(gif);
+	delete gif;
+	delete[] data;
+
+	SDL_DestroyMutex(mutex);
+	SDL_DestroyMutex(gifMutex);
+}
+
+GifStream *GifStream::clone() const
+{
+	gif_bitmap_callback_vt callbacks = gif->bitmap_callbacks;
+
+	gif_animation *copy = new gif_animation;
+	gif_create(copy, &callbacks);
+
+	unsigned char *dataCopy = new unsigned char[dataSize];
+	memcpy(dataCopy, data, dataSize);
+
+	int status;
+	do {
+		status = gif_initialise(copy, dataSize, dataCopy);
+		if (status != GIF_OK && status != GIF_WORKING) {
+			gif_finalise(copy);
+			delete copy;
+			delete[] dataCopy;
+			throw Exception(Exception::MKXPError, "Failed to initialize GIF (Error %d)", status);
+		}
+	} while (status != GIF_OK);
+
+	return new GifStream(copy, dataCopy, dataSize, frames);
+}
+
+int GifStream::frameCount() const
+{
+	return frames;
+}
+
+TEXFBO &GifStream::frame(int i)
+{
+	++useCounter;
+
+	for (size_t j = 0; j < textures.size(); ++j)
+		if (textures[j].frame == i)
+		{
+			textures[j].lastUse = useCounter;
+			return textures[j].tex;
+		}
+
+	Texture &t = freeTexture();
+	t.frame = i;
+	t.lastUse = useCounter;
+
+	SDL_LockMutex(mutex);
+
+	Buffer *buf = findBuffer(i, true);
+
+	if (buf)
+		upload(t, &buf->pixels[0]);
+
+	SDL_UnlockMutex(mutex);
+
+	if (buf)
+		return t.tex;
+
+	/* The decode threads aren't there yet */
+	SDL_LockMutex(gifMutex);
+
+	if (decodeTo(i))
+		upload(t, decodedPixels());
+	else
+		Debug() << "Failed to decode GIF frame" << i + 1 << "out of" << frames;
+
+	SDL_UnlockMutex(gifMutex);
+
+	return t.tex;
+}
+
+void GifStream::advance(int i, bool loop)
+{
+	SDL_LockMutex(mutex);
+
+	const bool moved = !started || shown != i || this->loop != loop;
+
+	shown = i;
+	this->loop = loop;
+	started = true;
+
+	/* Get the next frame onto the GPU before it's due */
+	const int next = frameAfter(i, 1);
+	const bool nextReady = next >= 0 && findBuffer(next, true);
+	const bool decoding = !failed;
+
+	SDL_UnlockMutex(mutex);
+
+	/* Without decode threads, frames are only decoded as they're shown */
+	if (moved && decoding)
+		shState->imageLoader().decodeStream(this);
+
+	if (nextReady && !isResident(next))
+		frame(next);
+}
+
+void GifStream::decodeAll(std::vector<TEXFBO> &out)
+{
+	TexPool &pool = shState->texPool();
+	std::vector<TEXFBO> decoded;
+
+	SDL_LockMutex(gifMutex);
+
+	for (int i = 0; i < frames; ++i)
+	{
+		if (!decodeTo(i))
+		{
+			SDL_UnlockMutex(gifMutex);
+
+			for (size_t j = 0; j < decoded.size(); ++j)
+				pool.release(decoded[j]);
+
+			throw Exception(Exception::MKXPError, "Failed to decode GIF frame %i out of %i",
+			                i + 1, frames);
+		}
+
+		TEXFBO tex;
+
+		try
+		{
+			tex = pool.request(width, height);
+		}
+		catch (const Exception &e)
+		{
+			SDL_UnlockMutex(gifMutex);
+
+			for (size_t j = 0; j < decoded.size(); ++j)
+				pool.release(decoded[j]);
+
+			throw e;
+		}
+
+		TEX::bind(tex.tex);
+		TEX::uploadImage(width, height, decodedPixels(), GL_RGBA);
+
+		decoded.push_back(tex);
+	}
+
+	SDL_UnlockMutex(gifMutex);
+
+	out.insert(out.end(), decoded.begin(), decoded.end());
+}
+
+bool GifStream::decodeTo(int i)
+{
+	if (gif->decoded_frame == i)
+		return true;
+
+	/* Frames are drawn on top of the ones before them,
+	 * so going back means starting over */
+	int from = (gif->decoded_frame >= 0 && gif->decoded_frame < i) ? gif->decoded_frame + 1 : 0;
+
+	for (int j = from; j <= i; ++j)
+	{
+		gif_result status = gif_decode_frame(gif, j);
+
+		if (status != GIF_OK && status != GIF_WORKING)
+			return false;
+	}
+
+	return true;
+}
+
+const uint8_t *GifStream::decodedPixels() const
+{
+	return gif->bitmap_callbacks.bitmap_get_buffer(gif->frame_image);
+}
+
+GifStream::Texture &GifStream::freeTexture()
+{
+	TexPool &pool = shState->texPool();
+
+	if (textures.size() < (size_t) textureRing)
+	{
+		Texture t;
+		t.frame = -1;
+		t.tex = pool.request(width, height);
+		t.lastUse = 0;
+
+		textures.push_back(t);
+
+		return textures.back();
+	}
+
+	size_t lru = 0;
+
+	for (size_t j = 1; j < textures.size(); ++j)
+		if (textures[j].lastUse < textures[lru].lastUse)
+			lru = j;
+
+	Texture &t = textures[lru];
+
+	/* A Bitmap copy still uses it */
+	if (pool.isShared(t.tex))
+	{
+		pool.release(t.tex);
+		t.tex = pool.request(width, height);
+	}
+
+	return t;
+}
+
+void GifStream::upload(Texture &t, const uint8_t *pixels)
+{
+	TEX::bind(t.tex.tex);
+	TEX::uploadSubImage(0, 0, width, height, pixels, GL_RGBA);
+}
+
+bool GifStream::isResident(int i) const
+{
+	for (size_t j = 0; j < textures.size(); ++j)
+		if (textures[j].frame == i)
+			return true;
+
+	return false;
+}
+
+int GifStream::frameAfter(int i, int n) const
+{
+	int f = i + n;
+
+	if (f >= frames)
+	{
+		if (!loop)
+			return -1;
+
+		f %= frames;
+	}
+
+	return f;
+}
+
+GifStream::Buffer *GifStream::findBuffer(int i, bool readyOnly)
+{
+	for (size_t j = 0; j < buffers.size(); ++j)
+		if (buffers[j].frame == i && (buffers[j].ready || !readyOnly))
+			return &buffers[j];
+
+	return 0;
+}
+
+bool GifStream::decodeNext()
+{
+	SDL_LockMutex(mutex);
+
+	int wanted[decodeAhead];
+	int next = -1;
+
+	for (int k = 0; k < decodeAhead; ++k)
+	{
+		wanted[k] = frameAfter(shown, k + 1);
+
+		if (next < 0 && wanted[k] >= 0 && !findBuffer(wanted[k], false))
+			next = wanted[k];
+	}
+
+	/* A buffer not holding any of the wanted frames */
+	Buffer *buf = 0;
+
+	for (size_t j = 0; j < buffers.size() && next >= 0 && !buf; ++j)
+	{
+		buf = &buffers[j];
+
+		for (int k = 0; k < decodeAhead; ++k)
+			if (buffers[j].frame == wanted[k])
+				buf = 0;
+	}
+
+	if (!buf || failed)
+	{
+		SDL_UnlockMutex(mutex);
+		return false;
+	}
+
+	/* Not ready, so the GL thread keeps its hands off */
+	buf->frame = next;
+	buf->ready = false;
+
+	SDL_UnlockMutex(mutex);
+
+	SDL_LockMutex(gifMutex);
+
+	bool ok = decodeTo(next);
+
+	if (ok)
+	{
+		buf->pixels.resize(width * height * 4);
+		memcpy(&buf->pixels[0], decodedPixels(), buf->pixels.size());
+	}
+
+	SDL_UnlockMutex(gifMutex);
+
+	SDL_LockMutex(mutex);
+
+	buf->ready = ok;
+
+	if (!ok)
+	{
+		buf->frame = -1;
+		failed = true;
+	}
+
+	SDL_UnlockMutex(mutex);
+
+	return ok;
+}
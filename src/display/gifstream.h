@@ -0,0 +1,117 @@
+/*
+** gifstream.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GIFSTREAM_H
+#define GIFSTREAM_H
+
+#include "gl-util.h"
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+struct SDL_mutex;
+struct gif_animation;
+
+/* Plays back an animated GIF without keeping every frame as a
+ * texture. The ImageLoader's decode threads decode the frames
+ * following the one on screen into a few pixel buffers, which are
+ * uploaded into an equally small ring of textures as they come up;
+ * the rest of the animation stays compressed in memory */
+class GifStream
+{
+public:
+	/* Takes over 'gif', initialised from 'data' */
+	GifStream(gif_animation *gif, unsigned char *data, size_t dataSize, int frameCount);
+	~GifStream();
+
+	/* Another stream over the same data, starting from scratch */
+	GifStream *clone() const;
+
+	int frameCount() const;
+
+	/* Texture holding frame 'i', decoding it right here if the
+	 * worker hasn't gotten to it. Only valid until the next few
+	 * frames are requested. GL thread only */
+	TEXFBO &frame(int i);
+
+	/* Has the decode threads decode the frames following 'i'.
+	 * Call once per frame while playing, with the GL context
+	 * current */
+	void advance(int i, bool loop);
+
+	/* Decodes every frame into new textures appended to 'out' */
+	void decodeAll(std::vector<TEXFBO> &out);
+
+	/* Decodes one of the frames coming up into a buffer. Returns
+	 * false if there was nothing left to decode, or it failed.
+	 * Called on the ImageLoader's threads */
+	bool decodeNext();
+
+private:
+	struct Texture
+	{
+		int frame;
+		TEXFBO tex;
+		unsigned int lastUse;
+	};
+
+	struct Buffer
+	{
+		int frame;
+		bool ready;
+		std::vector<uint8_t> pixels;
+	};
+
+	bool decodeTo(int i);
+	const uint8_t *decodedPixels() const;
+
+	Texture &freeTexture();
+	void upload(Texture &t, const uint8_t *pixels);
+	bool isResident(int i) const;
+
+	int frameAfter(int i, int n) const;
+	Buffer *findBuffer(int i, bool readyOnly);
+
+	int width, height;
+	int frames;
+
+	/* Guards the decoder, which the decode
+	 * threads and the GL thread both use */
+	SDL_mutex *gifMutex;
+	gif_animation *gif;
+	unsigned char *data;
+	size_t dataSize;
+
+	/* GL thread only */
+	std::vector<Texture> textures;
+	unsigned int useCounter;
+
+	/* Shared with the decode threads */
+	SDL_mutex *mutex;
+	std::vector<Buffer> buffers;
+	int shown;
+	bool loop;
+	bool failed;
+	bool started;
+};
+
+#endif // GIFSTREAM_H
@@ -177,6 +177,55 @@ void initGLFunctions()
         GL_VAO_FUN;
     }
     
+    /* Buffer mapping entrypoints */
+    if (glMajor >= 3 || HAVE_EXT(ARB_map_buffer_range))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+        GL_MAP_BUFFER_RANGE_FUN;
+        GL_UNMAP_BUFFER_FUN;
+    }
+    else if (HAVE_EXT(EXT_map_buffer_range) && HAVE_EXT(OES_mapbuffer))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX "EXT"
+        GL_MAP_BUFFER_RANGE_FUN;
+#undef EXT_SUFFIX
+#define EXT_SUFFIX "OES"
+        GL_UNMAP_BUFFER_FUN;
+    }
+    
+    /* Timer query entrypoints */
+    if (!gles && HAVE_EXT(ARB_timer_query))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+        GL_TIMER_QUERY_FUN;
+    }
+    
+    /* Sync object entrypoints */
+    if (HAVE_EXT(ARB_sync) || (gles && glMajor >= 3))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+        GL_SYNC_FUN;
+    }
+    
+    /* Program binary entrypoints */
+    if (HAVE_EXT(ARB_get_program_binary) || (gles && glMajor >= 3))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX ""
+        GL_PROGRAM_BINARY_FUN;
+        GL_PROGRAM_PARAMETER_FUN;
+    }
+    else if (HAVE_EXT(OES_get_program_binary))
+    {
+#undef EXT_SUFFIX
+#define EXT_SUFFIX "OES"
+        GL_PROGRAM_BINARY_FUN;
+    }
+    
     /* Debug callback entrypoints */
     if (HAVE_EXT(KHR_debug))
     {
@@ -204,4 +253,10 @@ void initGLFunctions()
     
     if (!gles || glMajor >= 3 || HAVE_EXT(OES_texture_npot))
         gl.npot_repeat = true;
+    
+    if (!gles || glMajor >= 3 || HAVE_EXT(OES_element_index_uint))
+        gl.element_index_uint = true;
+    
+    if (glMajor >= 3 || (!gles && HAVE_EXT(ARB_pixel_buffer_object)))
+        gl.pixel_pack_buffer = true;
 }
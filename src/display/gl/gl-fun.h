@@ -29,10 +29,13 @@
 #include <SDL_opengl.h>
 #endif
 
+#include <stdint.h>
+
 /* Etc */
 typedef GLenum (APIENTRYP _PFNGLGETERRORPROC) (void);
 typedef void (APIENTRYP _PFNGLCLEARCOLORPROC) (GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha);
 typedef void (APIENTRYP _PFNGLCLEARPROC) (GLbitfield mask);
+typedef void (APIENTRYP _PFNGLFINISHPROC) (void);
 typedef const GLubyte * (APIENTRYP _PFNGLGETSTRINGPROC) (GLenum name);
 typedef void (APIENTRYP _PFNGLGETINTEGERVPROC) (GLenum pname, GLint *params);
 typedef void (APIENTRYP _PFNGLPIXELSTOREIPROC) (GLenum pname, GLint param);
@@ -113,6 +116,29 @@ typedef void (APIENTRYP _PFNGLGENVERTEXARRAYSPROC) (GLsizei n, GLuint* arrays);
 typedef void (APIENTRYP _PFNGLDELETEVERTEXARRAYSPROC) (GLsizei n, const GLuint* arrays);
 typedef void (APIENTRYP _PFNGLBINDVERTEXARRAYPROC) (GLuint array);
 
+/* Buffer mapping */
+typedef void * (APIENTRYP _PFNGLMAPBUFFERRANGEPROC) (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (APIENTRYP _PFNGLUNMAPBUFFERPROC) (GLenum target);
+
+/* Timer query */
+typedef void (APIENTRYP _PFNGLGENQUERIESPROC) (GLsizei n, GLuint *ids);
+typedef void (APIENTRYP _PFNGLDELETEQUERIESPROC) (GLsizei n, const GLuint *ids);
+typedef void (APIENTRYP _PFNGLBEGINQUERYPROC) (GLenum target, GLuint id);
+typedef void (APIENTRYP _PFNGLENDQUERYPROC) (GLenum target);
+typedef void (APIENTRYP _PFNGLGETQUERYOBJECTUIVPROC) (GLuint id, GLenum pname, GLuint *params);
+typedef void (APIENTRYP _PFNGLGETQUERYOBJECTUI64VPROC) (GLuint id, GLenum pname, uint64_t *params);
+
+/* Sync objects */
+typedef struct __GLsync *_GLsync;
+typedef _GLsync (APIENTRYP _PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRYP _PFNGLCLIENTWAITSYNCPROC) (_GLsync sync, GLbitfield flags, uint64_t timeout);
+typedef void (APIENTRYP _PFNGLDELETESYNCPROC) (_GLsync sync);
+
+/* Program binary */
+typedef void (APIENTRYP _PFNGLGETPROGRAMBINARYPROC) (GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP _PFNGLPROGRAMBINARYPROC) (GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP _PFNGLPROGRAMPARAMETERIPROC) (GLuint program, GLenum pname, GLint value);
+
 /* GLES only */
 typedef void (APIENTRYP _PFNGLRELEASESHADERCOMPILERPROC) (void);
 
@@ -125,11 +151,65 @@ typedef void (APIENTRYP _PFNGLRELEASESHADERCOMPILERPROC) (void);
 #define GL_UNPACK_SKIP_ROWS 0x0CF3
 #endif
 
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_RANGE_BIT
+#define GL_MAP_INVALIDATE_RANGE_BIT 0x0004
+#endif
+#ifndef GL_MAP_UNSYNCHRONIZED_BIT
+#define GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+#endif
+
+#ifndef GL_MAP_READ_BIT
+#define GL_MAP_READ_BIT 0x0001
+#endif
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#endif
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED 0x911A
+#endif
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+
 #define GL_20_FUN \
 	/* Etc */ \
 	GL_FUN(GetError, _PFNGLGETERRORPROC) \
 	GL_FUN(ClearColor, _PFNGLCLEARCOLORPROC) \
 	GL_FUN(Clear, _PFNGLCLEARPROC) \
+	GL_FUN(Finish, _PFNGLFINISHPROC) \
 	GL_FUN(GetString, _PFNGLGETSTRINGPROC) \
 	GL_FUN(GetIntegerv, _PFNGLGETINTEGERVPROC) \
 	GL_FUN(PixelStorei, _PFNGLPIXELSTOREIPROC) \
@@ -206,6 +286,36 @@ typedef void (APIENTRYP _PFNGLRELEASESHADERCOMPILERPROC) (void);
 	GL_FUN(DeleteVertexArrays, _PFNGLDELETEVERTEXARRAYSPROC) \
 	GL_FUN(BindVertexArray, _PFNGLBINDVERTEXARRAYPROC)
 
+#define GL_MAP_BUFFER_RANGE_FUN \
+	/* Buffer mapping */ \
+	GL_FUN(MapBufferRange, _PFNGLMAPBUFFERRANGEPROC)
+
+#define GL_UNMAP_BUFFER_FUN \
+	GL_FUN(UnmapBuffer, _PFNGLUNMAPBUFFERPROC)
+
+#define GL_TIMER_QUERY_FUN \
+	/* Timer query */ \
+	GL_FUN(GenQueries, _PFNGLGENQUERIESPROC) \
+	GL_FUN(DeleteQueries, _PFNGLDELETEQUERIESPROC) \
+	GL_FUN(BeginQuery, _PFNGLBEGINQUERYPROC) \
+	GL_FUN(EndQuery, _PFNGLENDQUERYPROC) \
+	GL_FUN(GetQueryObjectuiv, _PFNGLGETQUERYOBJECTUIVPROC) \
+	GL_FUN(GetQueryObjectui64v, _PFNGLGETQUERYOBJECTUI64VPROC)
+
+#define GL_SYNC_FUN \
+	/* Sync objects */ \
+	GL_FUN(FenceSync, _PFNGLFENCESYNCPROC) \
+	GL_FUN(ClientWaitSync, _PFNGLCLIENTWAITSYNCPROC) \
+	GL_FUN(DeleteSync, _PFNGLDELETESYNCPROC)
+
+#define GL_PROGRAM_BINARY_FUN \
+	/* Program binary */ \
+	GL_FUN(GetProgramBinary, _PFNGLGETPROGRAMBINARYPROC) \
+	GL_FUN(ProgramBinary, _PFNGLPROGRAMBINARYPROC)
+
+#define GL_PROGRAM_PARAMETER_FUN \
+	GL_FUN(ProgramParameteri, _PFNGLPROGRAMPARAMETERIPROC)
+
 #define GL_DEBUG_KHR_FUN \
 	GL_FUN(DebugMessageCallback, _PFNGLDEBUGMESSAGECALLBACKPROC)
 
@@ -222,12 +332,20 @@ struct GLFunctions
 	GL_FBO_FUN
 	GL_FBO_BLIT_FUN
 	GL_VAO_FUN
+	GL_MAP_BUFFER_RANGE_FUN
+	GL_UNMAP_BUFFER_FUN
+	GL_TIMER_QUERY_FUN
+	GL_SYNC_FUN
+	GL_PROGRAM_BINARY_FUN
+	GL_PROGRAM_PARAMETER_FUN
 	GL_DEBUG_KHR_FUN
 	GL_GREMEMDY_FUN
 
 	bool glsles;
 	bool unpack_subimage;
 	bool npot_repeat;
+	bool element_index_uint;
+	bool pixel_pack_buffer;
 
 #undef GL_FUN
 };
@@ -26,6 +26,15 @@
 #include "quad.h"
 #include "config.h"
 #include "etc.h"
+#include "global-ibo.h"
+
+#include <algorithm>
+
+namespace TEX
+{
+	ID boundTextureID;
+	unsigned long skippedBinds = 0;
+}
 
 namespace FBO
 {
@@ -74,20 +83,28 @@ void subRectImageEnd()
 
 #define HAVE_NATIVE_VAO gl.GenVertexArrays
 
-static void vaoBindRes(VAO &vao)
+/* Points the attributes at vertex data starting
+ * 'base' bytes into the currently bound VBO */
+static void vaoSetAttribs(VAO &vao, size_t base)
 {
-	VBO::bind(vao.vbo);
-	IBO::bind(vao.ibo);
-
 	for (size_t i = 0; i < vao.attrCount; ++i)
 	{
 		const VertexAttribute &va = vao.attr[i];
+		const GLvoid *offset = (const char*) va.offset + base;
 
 		gl.EnableVertexAttribArray(va.index);
-		gl.VertexAttribPointer(va.index, va.size, va.type, GL_FALSE, vao.vertSize, va.offset);
+		gl.VertexAttribPointer(va.index, va.size, va.type, GL_FALSE, vao.vertSize, offset);
 	}
 }
 
+static void vaoBindRes(VAO &vao)
+{
+	VBO::bind(vao.vbo);
+	IBO::bind(vao.ibo);
+
+	vaoSetAttribs(vao, 0);
+}
+
 void vaoInit(VAO &vao, bool keepBound)
 {
 	if (HAVE_NATIVE_VAO)
@@ -138,6 +155,37 @@ void vaoUnbind(VAO &vao)
 	}
 }
 
+void drawQuads(VAO &vao, size_t offset, size_t count)
+{
+	GlobalIBO &ibo = shState->globalIBO();
+	const size_t limit = ibo.quadLimit();
+
+	if (offset + count <= limit)
+	{
+		const char *_offset = (const char*) 0 + offset * 6 * ibo.indexSize();
+		gl.DrawElements(GL_TRIANGLES, count * 6, ibo.indexType(), _offset);
+
+		return;
+	}
+
+	/* The indices can't reach this far; rebase the
+	 * attributes onto every chunk and draw it from 0 */
+	VBO::bind(vao.vbo);
+
+	while (count > 0)
+	{
+		size_t chunk = std::min(count, limit);
+
+		vaoSetAttribs(vao, offset * 4 * vao.vertSize);
+		gl.DrawElements(GL_TRIANGLES, chunk * 6, ibo.indexType(), 0);
+
+		offset += chunk;
+		count -= chunk;
+	}
+
+	vaoSetAttribs(vao, 0);
+}
+
 #define HAVE_NATIVE_BLIT (gl.BlitFramebuffer && shState->config().smoothScaling <= Bilinear && shState->config().smoothScalingDown <= Bilinear)
 
 int blitScaleIsSpecial(TEXFBO &target, bool targetPreferHires, const IntRect &targetRect, TEXFBO &source, const IntRect &sourceRect)
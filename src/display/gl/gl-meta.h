@@ -64,6 +64,10 @@ void vaoFini(VAO &vao);
 void vaoBind(VAO &vao);
 void vaoUnbind(VAO &vao);
 
+/* Draws 'count' quads starting at quad 'offset' of the bound
+ * VAO's vertex data, indexed through the global IBO */
+void drawQuads(VAO &vao, size_t offset, size_t count);
+
 /* EXT_framebuffer_blit */
 int blitScaleIsSpecial(TEXFBO &target, bool targetPreferHires, const IntRect &targetRect, TEXFBO &source, const IntRect &sourceRect);
 int smoothScalingMethod(int scaleIsSpecial);
@@ -63,13 +63,31 @@ namespace TEX
 		return id;
 	}
 
+	/* Texture currently bound to unit 0, which is the
+	 * only unit bound through here */
+	extern ID boundTextureID;
+
+	/* Binds skipped because the texture was already bound */
+	extern unsigned long skippedBinds;
+
 	static inline void del(ID id)
 	{
+		/* Deleted names may be handed out again by gen() */
+		if (id == boundTextureID)
+			boundTextureID = ID(0);
+
 		gl.DeleteTextures(1, &id.gl);
 	}
 
 	static inline void bind(ID id)
 	{
+		if (id == boundTextureID)
+		{
+			++skippedBinds;
+			return;
+		}
+
+		boundTextureID = id;
 		gl.BindTexture(GL_TEXTURE_2D, id.gl);
 	}
 
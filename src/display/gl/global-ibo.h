@@ -25,20 +25,26 @@
 #include "gl-util.h"
 
 #include <vector>
-#include <limits>
-#include <assert.h>
+#include <algorithm>
 #include <stdint.h>
 
-typedef uint16_t index_t;
-#define INDEX_T_MAX std::numeric_limits<index_t>::max()
-#define _GL_INDEX_TYPE GL_UNSIGNED_SHORT
-
+/* Index buffer describing consecutive quads (4 vertices, 2 triangles
+ * each), shared by everything that draws quads. Indices are 32 bit
+ * wide where the driver supports it; otherwise a single draw can only
+ * address the first 16384 quads of a vertex buffer, and GLMeta::drawQuads
+ * splits larger ones into chunks. */
 struct GlobalIBO
 {
 	IBO::ID ibo;
-	std::vector<index_t> buffer;
+	std::vector<uint16_t> buffer16;
+	std::vector<uint32_t> buffer32;
+
+	bool wide;
+	size_t quadCount;
 
 	GlobalIBO()
+	    : wide(gl.element_index_uint),
+	      quadCount(0)
 	{
 		ibo = IBO::gen();
 	}
@@ -48,13 +54,45 @@ struct GlobalIBO
 		IBO::del(ibo);
 	}
 
+	GLenum indexType() const
+	{
+		return wide ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+	}
+
+	size_t indexSize() const
+	{
+		return wide ? sizeof(uint32_t) : sizeof(uint16_t);
+	}
+
+	/* Number of quads a single draw call can reach */
+	size_t quadLimit() const
+	{
+		return wide ? UINT32_MAX / 4 : (UINT16_MAX + 1) / 4;
+	}
+
 	void ensureSize(size_t quadCount)
 	{
-		assert(quadCount*6 < INDEX_T_MAX);
+		quadCount = std::min(quadCount, quadLimit());
 
-		if (buffer.size() >= quadCount*6)
+		if (this->quadCount >= quadCount)
 			return;
 
+		IBO::bind(ibo);
+
+		if (wide)
+			upload(buffer32, quadCount);
+		else
+			upload(buffer16, quadCount);
+
+		IBO::unbind();
+
+		this->quadCount = quadCount;
+	}
+
+private:
+	template<typename index_t>
+	void upload(std::vector<index_t> &buffer, size_t quadCount)
+	{
 		size_t startInd = buffer.size() / 6;
 		buffer.reserve(quadCount*6);
 
@@ -66,9 +104,7 @@ struct GlobalIBO
 				buffer.push_back(i * 4 + indTemp[j]);
 		}
 
-		IBO::bind(ibo);
 		IBO::uploadData(buffer.size() * sizeof(index_t), dataPtr(buffer));
-		IBO::unbind();
 	}
 };
 
@@ -0,0 +1,166 @@
+/*
+** gpuprofiler.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gpuprofiler.h"
+
+#include <string.h>
+
+static const char *categoryNames[] =
+{
+	"tilemap",
+	"sprites",
+	"planes",
+	"windows",
+	"viewport_effects",
+	"transition",
+	"present"
+};
+
+GPUProfiler::GPUProfiler()
+    : supported(gl.BeginQuery != 0),
+      active(None),
+      current(0),
+      historyNext(0),
+      historyCount(0)
+{
+	for (size_t i = 0; i < QueuedFrames; ++i)
+		frames[i].used = 0;
+
+	memset(history, 0, sizeof(history));
+	memset(sums, 0, sizeof(sums));
+}
+
+GPUProfiler::~GPUProfiler()
+{
+	if (!supported)
+		return;
+
+	setCategory(None);
+
+	for (size_t i = 0; i < QueuedFrames; ++i)
+		for (size_t j = 0; j < frames[i].queries.size(); ++j)
+			gl.DeleteQueries(1, &frames[i].queries[j].id);
+}
+
+const char *GPUProfiler::categoryName(Category category)
+{
+	return categoryNames[category];
+}
+
+void GPUProfiler::setCategory(Category category)
+{
+	if (!supported || category == active)
+		return;
+
+	if (active != None)
+		gl.EndQuery(GL_TIME_ELAPSED);
+
+	active = category;
+
+	if (category == None)
+		return;
+
+	Frame &frame = frames[current];
+
+	if (frame.used == frame.queries.size())
+	{
+		Query query;
+		gl.GenQueries(1, &query.id);
+		frame.queries.push_back(query);
+	}
+
+	Query &query = frame.queries[frame.used++];
+	query.category = category;
+
+	gl.BeginQuery(GL_TIME_ELAPSED, query.id);
+}
+
+void GPUProfiler::endFrame()
+{
+	if (!supported)
+		return;
+
+	setCategory(None);
+
+	/* Reuse the oldest frame's queries */
+	current = (current + 1) % QueuedFrames;
+	resolve(frames[current]);
+}
+
+void GPUProfiler::resolve(Frame &frame)
+{
+	if (frame.used == 0)
+		return;
+
+	/* Queries finish in order; if the last one isn't done
+	 * yet, drop this frame rather than wait for it */
+	GLuint available = 0;
+	gl.GetQueryObjectuiv(frame.queries[frame.used-1].id, GL_QUERY_RESULT_AVAILABLE, &available);
+
+	if (!available)
+	{
+		frame.used = 0;
+		return;
+	}
+
+	double *totals = history[historyNext];
+
+	for (size_t i = 0; i < CategoryCount; ++i)
+		sums[i] -= totals[i];
+
+	memset(totals, 0, sizeof(history[0]));
+
+	for (size_t i = 0; i < frame.used; ++i)
+	{
+		uint64_t elapsed = 0;
+		gl.GetQueryObjectui64v(frame.queries[i].id, GL_QUERY_RESULT, &elapsed);
+
+		totals[frame.queries[i].category] += elapsed / 1000000.0;
+	}
+
+	for (size_t i = 0; i < CategoryCount; ++i)
+		sums[i] += totals[i];
+
+	historyNext = (historyNext + 1) % HistorySize;
+
+	if (historyCount < HistorySize)
+		++historyCount;
+
+	frame.used = 0;
+}
+
+double GPUProfiler::average(Category category) const
+{
+	if (historyCount == 0)
+		return 0;
+
+	return sums[category] / historyCount;
+}
+
+double GPUProfiler::averageTotal() const
+{
+	double total = 0;
+
+	for (size_t i = 0; i < CategoryCount; ++i)
+		total += average((Category) i);
+
+	return total;
+}
@@ -0,0 +1,105 @@
+/*
+** gpuprofiler.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+#include "gl-fun.h"
+
+#include <vector>
+#include <stddef.h>
+
+/* Measures GPU time per category of draw calls with GL_TIME_ELAPSED
+ * queries. Draw code announces its category; consecutive draws of
+ * the same category share one query. Results are read back several
+ * frames later, and only once available, so the CPU never waits on
+ * them. Without ARB_timer_query (eg. on GLES) everything is a no-op. */
+class GPUProfiler
+{
+public:
+	enum Category
+	{
+		None = -1,
+
+		Tilemap,
+		Sprites,
+		Planes,
+		Windows,
+		ViewportEffects,
+		Transition,
+		Present,
+
+		CategoryCount
+	};
+
+	GPUProfiler();
+	~GPUProfiler();
+
+	bool isSupported() const { return supported; }
+
+	/* Attributes all following draw calls to 'category' */
+	void setCategory(Category category);
+
+	/* Stops timing, starts a new frame and collects
+	 * the results of earlier frames that are ready */
+	void endFrame();
+
+	/* GPU time per frame in milliseconds,
+	 * averaged over the last resolved frames */
+	double average(Category category) const;
+	double averageTotal() const;
+
+	static const char *categoryName(Category category);
+
+private:
+	struct Query
+	{
+		GLuint id;
+		Category category;
+	};
+
+	struct Frame
+	{
+		std::vector<Query> queries;
+		size_t used;
+	};
+
+	void resolve(Frame &frame);
+
+	enum
+	{
+		QueuedFrames = 4,
+		HistorySize = 60
+	};
+
+	bool supported;
+	Category active;
+
+	Frame frames[QueuedFrames];
+	size_t current;
+
+	double history[HistorySize][CategoryCount];
+	double sums[CategoryCount];
+	size_t historyNext;
+	size_t historyCount;
+};
+
+#endif // GPUPROFILER_H
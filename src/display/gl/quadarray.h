@@ -27,6 +27,7 @@
 #include "gl-meta.h"
 #include "sharedstate.h"
 #include "global-ibo.h"
+#include "vertexstream.h"
 #include "shader.h"
 
 #include <vector>
@@ -37,20 +38,21 @@ struct QuadArray
 {
 	std::vector<VertexType> vertices;
 
-	VBO::ID vbo;
 	GLMeta::VAO vao;
 
 	size_t quadCount;
-	GLsizeiptr vboSize;
+
+	/* Position of the committed data in the vertex stream */
+	size_t streamBase;
+	unsigned int streamGen;
 
 	QuadArray()
 	    : quadCount(0),
-	      vboSize(-1)
+	      streamBase(0),
+	      streamGen(0)
 	{
-		vbo = VBO::gen();
-
 		GLMeta::vaoFillInVertexData<VertexType>(vao);
-		vao.vbo = vbo;
+		vao.vbo = shState->vertexStream().vbo();
 		vao.ibo = shState->globalIBO().ibo;
 
 		GLMeta::vaoInit(vao);
@@ -59,7 +61,6 @@ struct QuadArray
 	~QuadArray()
 	{
 		GLMeta::vaoFini(vao);
-		VBO::del(vbo);
 	}
 
 	void resize(size_t size)
@@ -74,38 +75,37 @@ struct QuadArray
 		quadCount = 0;
 	}
 
+	void append(const VertexType vert[4])
+	{
+		vertices.insert(vertices.end(), vert, vert + 4);
+		++quadCount;
+	}
+
 	/* This needs to be called after the final 'append()' call
 	 * and previous to the first 'draw()' call. */
 	void commit()
 	{
-		VBO::bind(vbo);
-
-		GLsizeiptr size = vertices.size() * sizeof(VertexType);
+		VertexStream &stream = shState->vertexStream();
 
-		if (size > vboSize)
-		{
-			/* New data exceeds already allocated size.
-			 * Reallocate VBO. */
-			VBO::uploadData(size, dataPtr(vertices), GL_DYNAMIC_DRAW);
-			vboSize = size;
+		streamBase = stream.upload(dataPtr(vertices), quadCount, sizeof(VertexType) * 4);
+		streamGen = stream.generation();
 
-			shState->ensureQuadIBO(quadCount);
-		}
-		else
-		{
-			/* New data fits in allocated size */
-			VBO::uploadSubData(0, size, dataPtr(vertices));
-		}
+		shState->ensureQuadIBO(streamBase + quadCount);
 
 		VBO::unbind();
 	}
 
 	void draw(size_t offset, size_t count)
 	{
+		/* The stream was recycled since our last commit */
+		if (streamGen != shState->vertexStream().generation())
+			commit();
+
+		offset += streamBase;
+
 		GLMeta::vaoBind(vao);
 
-		const char *_offset = (const char*) 0 + offset * 6 * sizeof(index_t);
-		gl.DrawElements(GL_TRIANGLES, count * 6, _GL_INDEX_TYPE, _offset);
+		GLMeta::drawQuads(vao, offset, count);
 
 		GLMeta::vaoUnbind(vao);
 	}
@@ -21,6 +21,11 @@
 
 #include "scene.h"
 #include "sharedstate.h"
+#include "spritebatch.h"
+
+#include <SDL_timer.h>
+
+#include <vector>
 
 Scene::Scene()
 {}
@@ -38,67 +43,203 @@ Scene::~Scene()
 
 void Scene::insert(SceneElement &element)
 {
-	IntruListLink<SceneElement> *iter;
+	element.orderKey.z = element.z;
+	element.orderKey.spriteY = element.spriteY;
 
-	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
+	std::set<SceneElement*, OrderLess>::iterator iter =
+		order.insert(&element).first;
+
+	/* Link in front of the next higher priority element */
+	if (++iter != order.end())
+		elements.insertBefore(element.link, (*iter)->link);
+	else
+		elements.append(element.link);
+
+	onContentChange();
+}
+
+void Scene::reinsert(SceneElement &element)
+{
+	remove(element);
+	insert(element);
+}
+
+void Scene::remove(SceneElement &element)
+{
+	/* Not currently linked */
+	if (!element.link.next)
+		return;
+
+	order.erase(&element);
+	elements.remove(element.link);
+
+	onContentChange();
+}
+
+bool Scene::OrderLess::operator()(const SceneElement *a, const SceneElement *b) const
+{
+	return *a < *b;
+}
+
+namespace
+{
+	/* Stand-in element for Scene::benchmarkOrdering() */
+	class OrderBenchElement : public SceneElement
 	{
-		SceneElement *e = iter->data;
+	public:
+		OrderBenchElement(Scene &scene)
+		    : SceneElement(scene)
+		{}
+
+		ABOUT_TO_ACCESS_NOOP
+
+	private:
+		void draw() {}
+	};
+}
+
+/* Spread out, and different every frame */
+static int benchSpriteY(int element, int frame)
+{
+	return (element * 7919 + frame * 104729) % 480;
+}
+
+SceneOrderBenchmark Scene::benchmarkOrdering(int count, int frames)
+{
+	Scene scene;
+	std::vector<SceneElement*> elems;
 
-		if (element < *e)
+	for (int i = 0; i < count; ++i)
+		elems.push_back(new OrderBenchElement(scene));
+
+	const uint64_t start = SDL_GetPerformanceCounter();
+
+	for (int f = 0; f < frames; ++f)
+		for (int i = 0; i < count; ++i)
 		{
-			elements.insertBefore(element.link, *iter);
-			return;
+			elems[i]->spriteY = benchSpriteY(i, f);
+			scene.reinsert(*elems[i]);
 		}
+
+	const uint64_t mid = SDL_GetPerformanceCounter();
+
+	/* What insertion used to do; leaves 'order' stale */
+	for (int f = 0; f < frames; ++f)
+		for (int i = 0; i < count; ++i)
+		{
+			SceneElement &element = *elems[i];
+
+			element.spriteY = benchSpriteY(i, frames + f);
+			element.orderKey.spriteY = element.spriteY;
+			scene.elements.remove(element.link);
+
+			IntruListLink<SceneElement> *iter;
+
+			for (iter = scene.elements.begin(); iter != scene.elements.end(); iter = iter->next)
+				if (element < *iter->data)
+					break;
+
+			if (iter != scene.elements.end())
+				scene.elements.insertBefore(element.link, *iter);
+			else
+				scene.elements.append(element.link);
+		}
+
+	const uint64_t end = SDL_GetPerformanceCounter();
+
+	scene.order.clear();
+
+	for (int i = 0; i < count; ++i)
+	{
+		scene.elements.remove(elems[i]->link);
+		elems[i]->scene = 0;
+		delete elems[i];
 	}
 
-	elements.append(element.link);
+	const double msPerTick = 1000.0 / SDL_GetPerformanceFrequency();
+
+	SceneOrderBenchmark result;
+	result.indexedMs = (mid - start) * msPerTick / frames;
+	result.linearMs = (end - mid) * msPerTick / frames;
+
+	return result;
 }
 
-void Scene::insertAfter(SceneElement &element, SceneElement &after)
+void Scene::notifyGeometryChange()
 {
 	IntruListLink<SceneElement> *iter;
 
-	for (iter = &after.link; iter != elements.end(); iter = iter->next)
+	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
 	{
-		SceneElement *e = iter->data;
-
-		if (element < *e)
-		{
-			elements.insertBefore(element.link, *iter);
-			return;
-		}
+		iter->data->onGeometryChange(geometry);
 	}
-
-	elements.append(element.link);
 }
 
-void Scene::reinsert(SceneElement &element)
+bool Scene::contentChangesTracked()
 {
-	elements.remove(element.link);
-	insert(element);
+	IntruListLink<SceneElement> *iter;
+
+	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
+	{
+		SceneElement *e = iter->data;
+
+		if (e->visible && !e->tracksContentChanges())
+			return false;
+	}
+
+	return true;
 }
 
-void Scene::notifyGeometryChange()
+bool Scene::normalBlendOnly()
 {
 	IntruListLink<SceneElement> *iter;
 
 	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
 	{
-		iter->data->onGeometryChange(geometry);
+		SceneElement *e = iter->data;
+
+		if (e->visible && !e->blendsNormally())
+			return false;
 	}
+
+	return true;
 }
 
 void Scene::composite()
 {
+	SpriteBatch &batch = shState->spriteBatch();
+	SceneStats &stats = shState->sceneStats();
 	IntruListLink<SceneElement> *iter;
 
 	for (iter = elements.begin(); iter != elements.end(); iter = iter->next)
 	{
 		SceneElement *e = iter->data;
 
-		if (e->visible)
-			e->draw();
+		if (!e->visible)
+			continue;
+
+		if (e->isEmpty())
+		{
+			++stats.empty;
+			continue;
+		}
+
+		if (e->isCulled())
+		{
+			++stats.culled;
+			continue;
+		}
+
+		++stats.drawn;
+
+		if (e->drawBatched(batch))
+			continue;
+
+		batch.flush();
+		e->draw();
 	}
+
+	batch.flush();
 }
 
 
@@ -158,7 +299,11 @@ void SceneElement::setVisible(bool value)
 {
 	aboutToAccess();
 
+	if (visible == value)
+		return;
+
 	visible = value;
+	notifyContentChange();
 }
 
 bool SceneElement::operator<(const SceneElement &o) const
@@ -167,17 +312,17 @@ bool SceneElement::operator<(const SceneElement &o) const
 	 * If two Z values are equal, the later created object
 	 * has priority */
 
-	if (z <= o.z)
+	if (orderKey.z <= o.orderKey.z)
 	{
-		if (z == o.z)
+		if (orderKey.z == o.orderKey.z)
 		{
 			if (rgssVer >= 2)
 			{
 				/* RGSS2: If two sprites' Z values collide,
 				 * their Y coordinates decide draw order. Only
 				 * on equal Y does the creation time take effect */
-				if (spriteY != o.spriteY)
-					return (spriteY < o.spriteY);
+				if (orderKey.spriteY != o.orderKey.spriteY)
+					return (orderKey.spriteY < o.orderKey.spriteY);
 			}
 
 			return (creationStamp < o.creationStamp);
@@ -191,12 +336,24 @@ bool SceneElement::operator<(const SceneElement &o) const
 
 void SceneElement::setSpriteY(int value)
 {
+	if (spriteY == value)
+		return;
+
 	spriteY = value;
-	scene->reinsert(*this);
+
+	/* Ordering by Y only exists since RGSS2 */
+	if (rgssVer >= 2)
+		scene->reinsert(*this);
+}
+
+void SceneElement::notifyContentChange()
+{
+	if (scene)
+		scene->onContentChange();
 }
 
 void SceneElement::unlink()
 {
 	if (scene)
-		scene->elements.remove(link);
+		scene->remove(*this);
 }
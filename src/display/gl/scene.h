@@ -27,13 +27,43 @@
 #include "etc.h"
 #include "etc-internal.h"
 
+#include <set>
+
 class SceneElement;
+class SpriteBatch;
 class Viewport;
 class WindowVX;
 class Window;
 struct ScanRow;
 struct TilemapPrivate;
 
+/* Element counts of the last screen composite, for diagnostics */
+struct SceneStats
+{
+	/* Elements that went through draw() */
+	unsigned int drawn;
+	/* Visible elements skipped because they were off screen */
+	unsigned int culled;
+	/* Visible elements skipped because they had nothing to draw */
+	unsigned int empty;
+
+	SceneStats()
+	    : drawn(0),
+	      culled(0),
+	      empty(0)
+	{}
+};
+
+/* Cost of reordering elements whose sprite Y changes every
+ * frame, with the ordered index and with the list walk it
+ * replaced */
+struct SceneOrderBenchmark
+{
+	/* Milliseconds per frame of 'count' reinsertions */
+	double indexedMs;
+	double linearMs;
+};
+
 class Scene
 {
 public:
@@ -61,17 +91,43 @@ public:
 
 	const Geometry &getGeometry() const { return geometry; }
 
+	/* Reinserts 'count' elements with new sprite Y values
+	 * 'frames' times over, in a scene of their own */
+	static SceneOrderBenchmark benchmarkOrdering(int count, int frames);
+
+	/* Called whenever an element of this scene changed in a
+	 * way that affects its appearance; scenes which keep their
+	 * composited content around use this to know it's stale */
+	virtual void onContentChange() {}
+
 protected:
 	void insert(SceneElement &element);
-	void insertAfter(SceneElement &element, SceneElement &after);
 	void reinsert(SceneElement &element);
+	void remove(SceneElement &element);
 
 	/* Notify all elements that geometry has changed */
 	void notifyGeometryChange();
 
+	/* True if every visible element tracks its content changes */
+	bool contentChangesTracked();
+
+	/* True if every visible element blends normally */
+	bool normalBlendOnly();
+
+	/* Elements in draw order */
 	IntruList<SceneElement> elements;
 	Geometry geometry;
 
+private:
+	struct OrderLess
+	{
+		bool operator()(const SceneElement *a, const SceneElement *b) const;
+	};
+
+	/* Same elements as above, keyed on their display priority
+	 * so that (re)insertion doesn't have to walk the list */
+	std::set<SceneElement*, OrderLess> order;
+
 	friend class SceneElement;
 	friend class Window;
 	friend class WindowVX;
@@ -86,6 +142,9 @@ public:
 
 	void setScene(Scene &scene);
 
+	/* Lets the scene know our appearance changed */
+	void notifyContentChange();
+
 	DECL_ATTR_VIRT( Z,       int  )
 	DECL_ATTR_VIRT( Visible, bool )
 
@@ -112,6 +171,31 @@ protected:
 	 */
 	virtual void draw() = 0;
 
+	/* Elements that can be rendered as a single plain textured
+	 * quad may queue themselves into 'batch' instead of drawing
+	 * directly. Returns false if a regular 'draw()' is required;
+	 * any pending batch is flushed before that happens. */
+	virtual bool drawBatched(SpriteBatch &) { return false; }
+
+	/* Returns true if the element cannot touch its scene's
+	 * visible area (judging from a conservative bounding box),
+	 * in which case drawing it is skipped altogether */
+	virtual bool isCulled() { return false; }
+
+	/* Returns true if the element wouldn't draw anything no
+	 * matter where it is (eg. a sprite without a bitmap) */
+	virtual bool isEmpty() { return false; }
+
+	/* Returns true if the element reports every change to its
+	 * appearance through 'notifyContentChange()'. Elements that
+	 * don't (eg. because they animate on their own) force caching
+	 * scenes to recomposite them every frame */
+	virtual bool tracksContentChanges() { return false; }
+
+	/* Returns true if the element is drawn with normal
+	 * (alpha) blending onto whatever is below it */
+	virtual bool blendsNormally() { return true; }
+
 	// FIXME: This should be a signal
 	virtual void onGeometryChange(const Scene::Geometry &) {}
 
@@ -144,6 +228,14 @@ private:
 	 * means that sprites created _after_ a window with the same Z will
 	 * still always be displayed below said window. */
 	int spriteY;
+
+	/* Priority the element was last inserted into its scene with.
+	 * Kept separately as 'z' may be changed before a reinsert. */
+	struct
+	{
+		int z;
+		int spriteY;
+	} orderKey;
 };
 
 #define ABOUT_TO_ACCESS_NOOP \
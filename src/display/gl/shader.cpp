@@ -25,10 +25,15 @@
 #include "sharedstate.h"
 #include "glstate.h"
 #include "exception.h"
+#include "debugwriter.h"
+#include "util.h"
 
 #include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <iostream>
+#include <map>
 
 #ifndef MKXPZ_BUILD_XCODE
 #include "common.h.xxd"
@@ -39,6 +44,7 @@
 #include "bitmapBlit.frag.xxd"
 #include "plane.frag.xxd"
 #include "gray.frag.xxd"
+#include "viewport.frag.xxd"
 #include "flatColor.frag.xxd"
 #include "simple.frag.xxd"
 #include "simpleColor.frag.xxd"
@@ -62,6 +68,9 @@
 #include "blurV.vert.xxd"
 #include "tilemapvx.vert.xxd"
 #include "obscured.frag.xxd"
+#include "glyph.frag.xxd"
+#include "textShadow.frag.xxd"
+#include "textShadow.vert.xxd"
 #endif
 
 #ifdef MKXPZ_BUILD_XCODE
@@ -144,14 +153,15 @@ std::string &Shader::commonHeader() {
 }
 #endif
 
-static void setupShaderSource(GLuint shader, GLenum type,
-                              const unsigned char *body, int bodySize)
+/* Fills in the source strings making up a shader of 'type',
+ * returns their count */
+static size_t shaderSourceParts(GLenum type,
+                                const unsigned char *body, int bodySize,
+                                const GLchar *shaderSrc[4], GLint shaderSrcSize[4])
 {
 	static const char glesDefine[] = "#define GLSLES\n";
 	static const char fragDefine[] = "#define FRAGMENT_SHADER\n";
 
-	const GLchar *shaderSrc[4];
-	GLint shaderSrcSize[4];
 	size_t i = 0;
 
 	if (gl.glsles)
@@ -181,7 +191,277 @@ static void setupShaderSource(GLuint shader, GLenum type,
 	shaderSrcSize[i] = bodySize;
 	++i;
 
-	gl.ShaderSource(shader, i, shaderSrc, shaderSrcSize);
+	return i;
+}
+
+static void setupShaderSource(GLuint shader, GLenum type,
+                              const unsigned char *body, int bodySize)
+{
+	const GLchar *shaderSrc[4];
+	GLint shaderSrcSize[4];
+
+	size_t count = shaderSourceParts(type, body, bodySize, shaderSrc, shaderSrcSize);
+
+	gl.ShaderSource(shader, count, shaderSrc, shaderSrcSize);
+}
+
+/* 64 bit FNV-1a */
+static const uint64_t fnvOffsetBasis = 0xcbf29ce484222325ULL;
+
+static uint64_t fnvHash(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = (const unsigned char*) data;
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static uint64_t hashShaderSource(uint64_t hash, GLenum type,
+                                 const unsigned char *body, int bodySize)
+{
+	const GLchar *shaderSrc[4];
+	GLint shaderSrcSize[4];
+
+	size_t count = shaderSourceParts(type, body, bodySize, shaderSrc, shaderSrcSize);
+
+	hash = fnvHash(hash, &type, sizeof(type));
+
+	for (size_t i = 0; i < count; ++i)
+		hash = fnvHash(hash, shaderSrc[i], shaderSrcSize[i]);
+
+	return hash;
+}
+
+/* Linked program binaries from earlier runs, keyed by a hash of
+ * the program's complete source. The whole cache is dropped when
+ * the driver identity (vendor, renderer, version) changes */
+struct ProgramBinaryCache
+{
+	struct Entry
+	{
+		GLenum format;
+		std::vector<unsigned char> data;
+	};
+
+	bool enabled;
+	bool dirty;
+	std::string path;
+	uint64_t driverKey;
+	std::map<uint64_t, Entry> entries;
+
+	ProgramBinaryCache()
+	    : enabled(false),
+	      dirty(false),
+	      driverKey(0)
+	{}
+
+	void read()
+	{
+		FILE *f = fopen(path.c_str(), "rb");
+
+		if (!f)
+			return;
+
+		/* Entry sizes are checked against what's actually
+		 * there before anything is allocated for them */
+		long fileSize = -1;
+
+		if (fseek(f, 0, SEEK_END) == 0)
+			fileSize = ftell(f);
+
+		if (fileSize < 0 || fseek(f, 0, SEEK_SET) != 0)
+		{
+			fclose(f);
+			return;
+		}
+
+		char magic[sizeof(fileMagic)];
+		uint32_t version, count;
+		uint64_t fileDriverKey;
+
+		bool valid = fread(magic, sizeof(magic), 1, f) == 1
+		          && fread(&version, sizeof(version), 1, f) == 1
+		          && fread(&fileDriverKey, sizeof(fileDriverKey), 1, f) == 1
+		          && fread(&count, sizeof(count), 1, f) == 1
+		          && memcmp(magic, fileMagic, sizeof(magic)) == 0
+		          && version == fileVersion
+		          && fileDriverKey == driverKey;
+
+		for (uint32_t i = 0; valid && i < count; ++i)
+		{
+			uint64_t key;
+			uint32_t format, size;
+
+			if (fread(&key, sizeof(key), 1, f) != 1
+			 || fread(&format, sizeof(format), 1, f) != 1
+			 || fread(&size, sizeof(size), 1, f) != 1
+			 || size == 0
+			 || size > (uint64_t) (fileSize - ftell(f)))
+			{
+				valid = false;
+				break;
+			}
+
+			Entry &entry = entries[key];
+			entry.format = format;
+			entry.data.resize(size);
+
+			if (fread(&entry.data[0], size, 1, f) != 1)
+				valid = false;
+		}
+
+		fclose(f);
+
+		/* Stale or truncated; start over and rewrite it later */
+		if (!valid)
+			entries.clear();
+	}
+
+	void write()
+	{
+		/* Written next to the cache and moved over it once
+		 * complete, so an interrupted save leaves the old one */
+		const std::string tmpPath = path + ".tmp";
+		FILE *f = fopen(tmpPath.c_str(), "wb");
+
+		if (!f)
+		{
+			Debug() << "Could not write shader cache" << path;
+			return;
+		}
+
+		uint32_t version = fileVersion;
+		uint32_t count = entries.size();
+
+		bool ok = fwrite(fileMagic, sizeof(fileMagic), 1, f) == 1
+		       && fwrite(&version, sizeof(version), 1, f) == 1
+		       && fwrite(&driverKey, sizeof(driverKey), 1, f) == 1
+		       && fwrite(&count, sizeof(count), 1, f) == 1;
+
+		std::map<uint64_t, Entry>::const_iterator iter;
+		for (iter = entries.begin(); ok && iter != entries.end(); ++iter)
+		{
+			uint32_t format = iter->second.format;
+			uint32_t size = iter->second.data.size();
+
+			ok = fwrite(&iter->first, sizeof(iter->first), 1, f) == 1
+			  && fwrite(&format, sizeof(format), 1, f) == 1
+			  && fwrite(&size, sizeof(size), 1, f) == 1
+			  && fwrite(&iter->second.data[0], size, 1, f) == 1;
+		}
+
+		if (fclose(f) != 0)
+			ok = false;
+
+		/* Windows won't rename over an existing file */
+		if (ok && rename(tmpPath.c_str(), path.c_str()) != 0)
+		{
+			remove(path.c_str());
+			ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+		}
+
+		if (!ok)
+		{
+			Debug() << "Could not write shader cache" << path;
+			remove(tmpPath.c_str());
+			return;
+		}
+
+		dirty = false;
+	}
+
+	/* Returns true if 'program' was successfully restored */
+	bool load(GLuint program, uint64_t key)
+	{
+		std::map<uint64_t, Entry>::iterator iter = entries.find(key);
+
+		if (iter == entries.end())
+			return false;
+
+		const Entry &entry = iter->second;
+		gl.ProgramBinary(program, entry.format, &entry.data[0], entry.data.size());
+
+		GLint success;
+		gl.GetProgramiv(program, GL_LINK_STATUS, &success);
+
+		if (success)
+			return true;
+
+		/* The driver may refuse binaries even if its version
+		 * string stayed the same; fall back to compiling */
+		entries.erase(iter);
+		dirty = true;
+
+		return false;
+	}
+
+	void store(GLuint program, uint64_t key)
+	{
+		GLint length = 0;
+		gl.GetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+		if (length <= 0)
+			return;
+
+		Entry &entry = entries[key];
+		entry.data.resize(length);
+		gl.GetProgramBinary(program, length, &length, &entry.format, &entry.data[0]);
+
+		if (length <= 0)
+		{
+			entries.erase(key);
+			return;
+		}
+
+		entry.data.resize(length);
+		dirty = true;
+	}
+
+	static const char fileMagic[8];
+	static const uint32_t fileVersion = 1;
+};
+
+const char ProgramBinaryCache::fileMagic[8] = { 'M', 'K', 'X', 'P', 'P', 'B', 'C', '\0' };
+
+static ProgramBinaryCache binaryCache;
+
+void Shader::initBinaryCache(const Config &conf)
+{
+	if (!conf.shaderCache || !gl.ProgramBinary || conf.customDataPath.empty())
+		return;
+
+	GLint formatCount = 0;
+	gl.GetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+
+	if (formatCount <= 0)
+		return;
+
+	const GLenum driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	uint64_t driverKey = fnvOffsetBasis;
+
+	for (size_t i = 0; i < ARRAY_SIZE(driverStrings); ++i)
+	{
+		const char *str = (const char*) gl.GetString(driverStrings[i]);
+
+		if (str)
+			driverKey = fnvHash(driverKey, str, strlen(str) + 1);
+	}
+
+	binaryCache.enabled = true;
+	binaryCache.path = conf.customDataPath + "shaders.cache";
+	binaryCache.driverKey = driverKey;
+	binaryCache.read();
+}
+
+void Shader::saveBinaryCache()
+{
+	if (binaryCache.enabled && binaryCache.dirty)
+		binaryCache.write();
 }
 
 void Shader::init(const unsigned char *vert, int vertSize,
@@ -190,6 +470,16 @@ void Shader::init(const unsigned char *vert, int vertSize,
                   const char *programName)
 {
 	GLint success;
+	uint64_t cacheKey = 0;
+
+	if (binaryCache.enabled)
+	{
+		cacheKey = hashShaderSource(fnvOffsetBasis, GL_VERTEX_SHADER, vert, vertSize);
+		cacheKey = hashShaderSource(cacheKey, GL_FRAGMENT_SHADER, frag, fragSize);
+
+		if (binaryCache.load(program, cacheKey))
+			return;
+	}
 
 	/* Compile vertex shader */
 	setupShaderSource(vertShader, GL_VERTEX_SHADER, vert, vertSize);
@@ -227,6 +517,9 @@ void Shader::init(const unsigned char *vert, int vertSize,
 	gl.BindAttribLocation(program, TexCoord, "texCoord");
 	gl.BindAttribLocation(program, Color, "color");
 
+	if (binaryCache.enabled && gl.ProgramParameteri)
+		gl.ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
 	gl.LinkProgram(program);
 
 	gl.GetProgramiv(program, GL_LINK_STATUS, &success);
@@ -238,6 +531,9 @@ void Shader::init(const unsigned char *vert, int vertSize,
 	                    "GLSL: An error occured while linking program '%s' (vertex '%s', fragment '%s')",
 	                    programName, vertName, fragName);
 	}
+
+	if (binaryCache.enabled)
+		binaryCache.store(program, cacheKey);
 }
 
 void Shader::initFromFile(const char *_vertFile, const char *_fragFile,
@@ -252,14 +548,77 @@ void Shader::initFromFile(const char *_vertFile, const char *_fragFile,
 	     _vertFile, _fragFile, programName);
 }
 
+/* Uniform locations beyond this are uploaded unconditionally */
+static const GLint maxShadowedUniform = 64;
+
+unsigned long Shader::skippedUniforms = 0;
+
+bool Shader::uniformChanged(GLint location, const void *data, size_t size)
+{
+	/* Inactive uniform, nothing to upload */
+	if (location < 0)
+		return false;
+
+	if (location >= maxShadowedUniform || size > sizeof(UniformShadow::data))
+		return true;
+
+	if (uniformShadow.size() <= (size_t) location)
+		uniformShadow.resize(location + 1);
+
+	UniformShadow &shadow = uniformShadow[location];
+
+	/* Uniform calls only reach the currently bound program;
+	 * don't remember values that might not have arrived */
+	if (glState.program.get() != program)
+	{
+		shadow.valid = false;
+		return true;
+	}
+
+	if (shadow.valid && memcmp(shadow.data, data, size) == 0)
+	{
+		++skippedUniforms;
+		return false;
+	}
+
+	memcpy(shadow.data, data, size);
+	shadow.valid = true;
+
+	return true;
+}
+
+void Shader::setFloatUniform(GLint location, float value)
+{
+	if (uniformChanged(location, &value, sizeof(value)))
+		gl.Uniform1f(location, value);
+}
+
+void Shader::setIntUniform(GLint location, int value)
+{
+	if (uniformChanged(location, &value, sizeof(value)))
+		gl.Uniform1i(location, value);
+}
+
 void Shader::setVec2Uniform(GLint location, const Vec2 &vec)
 {
-    gl.Uniform2f(location, vec.x, vec.y);
+	const GLfloat data[] = { vec.x, vec.y };
+
+	if (uniformChanged(location, data, sizeof(data)))
+		gl.Uniform2f(location, vec.x, vec.y);
 }
 
 void Shader::setVec4Uniform(GLint location, const Vec4 &vec)
 {
-	gl.Uniform4f(location, vec.x, vec.y, vec.z, vec.w);
+	const GLfloat data[] = { vec.x, vec.y, vec.z, vec.w };
+
+	if (uniformChanged(location, data, sizeof(data)))
+		gl.Uniform4f(location, vec.x, vec.y, vec.z, vec.w);
+}
+
+void Shader::setMatrixUniform(GLint location, const float value[16])
+{
+	if (uniformChanged(location, value, sizeof(float[16])))
+		gl.UniformMatrix4fv(location, 1, GL_FALSE, value);
 }
 
 void Shader::setTexUniform(GLint location, unsigned unitIndex, TEX::ID texture)
@@ -268,10 +627,15 @@ void Shader::setTexUniform(GLint location, unsigned unitIndex, TEX::ID texture)
 
 	gl.ActiveTexture(texUnit);
 	gl.BindTexture(GL_TEXTURE_2D, texture.gl);
-	gl.Uniform1i(location, unitIndex);
+	setIntUniform(location, unitIndex);
 	gl.ActiveTexture(GL_TEXTURE0);
 }
 
+unsigned long Shader::skippedUniformCount()
+{
+	return skippedUniforms;
+}
+
 void ShaderBase::GLProjMat::apply(const Vec2i &value)
 {
 	/* glOrtho replacement */
@@ -317,12 +681,12 @@ bool ShaderBase::framebufferScalingAllowed()
 
 void ShaderBase::setTexSize(const Vec2i &value)
 {
-	gl.Uniform2f(u_texSizeInv, 1.f / value.x, 1.f / value.y);
+	setVec2Uniform(u_texSizeInv, Vec2(1.f / value.x, 1.f / value.y));
 }
 
 void ShaderBase::setTranslation(const Vec2i &value)
 {
-	gl.Uniform2f(u_translation, value.x, value.y);
+	setVec2Uniform(u_translation, Vec2(value.x, value.y));
 }
 
 
@@ -352,7 +716,7 @@ SimpleShader::SimpleShader()
 
 void SimpleShader::setTexOffsetX(int value)
 {
-	gl.Uniform1f(u_texOffsetX, value);
+	setFloatUniform(u_texOffsetX, value);
 }
 
 
@@ -364,6 +728,22 @@ SimpleColorShader::SimpleColorShader()
 }
 
 
+GlyphShader::GlyphShader()
+{
+	INIT_SHADER(simpleColor, glyph, GlyphShader);
+
+	ShaderBase::init();
+}
+
+
+TextShadowShader::TextShadowShader()
+{
+	INIT_SHADER(textShadow, textShadow, TextShadowShader);
+
+	ShaderBase::init();
+}
+
+
 SimpleAlphaShader::SimpleAlphaShader()
 {
 	INIT_SHADER(simpleColor, simpleAlpha, SimpleAlphaShader);
@@ -383,7 +763,7 @@ SimpleSpriteShader::SimpleSpriteShader()
 
 void SimpleSpriteShader::setSpriteMat(const float value[16])
 {
-	gl.UniformMatrix4fv(u_spriteMat, 1, GL_FALSE, value);
+	setMatrixUniform(u_spriteMat, value);
 }
 
 BicubicSpriteShader::BicubicSpriteShader()
@@ -399,7 +779,7 @@ BicubicSpriteShader::BicubicSpriteShader()
 
 void BicubicSpriteShader::setSharpness(int sharpness)
 {
-	gl.Uniform2f(u_bc, 1.f - sharpness * 0.01f, sharpness * 0.005f);
+	setVec2Uniform(u_bc, Vec2(1.f - sharpness * 0.01f, sharpness * 0.005f));
 }
 
 ObscuredShader::ObscuredShader()
@@ -429,7 +809,7 @@ Lanczos3SpriteShader::Lanczos3SpriteShader()
 void Lanczos3SpriteShader::setTexSize(const Vec2i &value)
 {
 	ShaderBase::setTexSize(value);
-	gl.Uniform2f(u_sourceSize, (float)value.x, (float)value.y);
+	setVec2Uniform(u_sourceSize, Vec2((float)value.x, (float)value.y));
 }
 
 #ifdef MKXPZ_SSL
@@ -446,7 +826,7 @@ XbrzSpriteShader::XbrzSpriteShader()
 
 void XbrzSpriteShader::setTargetScale(const Vec2 &value)
 {
-	gl.Uniform2f(u_targetScale, value.x, value.y);
+	setVec2Uniform(u_targetScale, Vec2(value.x, value.y));
 }
 #endif
 
@@ -462,12 +842,12 @@ AlphaSpriteShader::AlphaSpriteShader()
 
 void AlphaSpriteShader::setSpriteMat(const float value[16])
 {
-	gl.UniformMatrix4fv(u_spriteMat, 1, GL_FALSE, value);
+	setMatrixUniform(u_spriteMat, value);
 }
 
 void AlphaSpriteShader::setAlpha(float value)
 {
-	gl.Uniform1f(u_alpha, value);
+	setFloatUniform(u_alpha, value);
 }
 
 
@@ -501,12 +881,12 @@ void TransShader::setTransMap(TEX::ID tex)
 
 void TransShader::setProg(float value)
 {
-	gl.Uniform1f(u_prog, value);
+	setFloatUniform(u_prog, value);
 }
 
 void TransShader::setVague(float value)
 {
-	gl.Uniform1f(u_vague, value);
+	setFloatUniform(u_vague, value);
 }
 
 
@@ -533,7 +913,7 @@ void SimpleTransShader::setFrozenScene(TEX::ID tex)
 
 void SimpleTransShader::setProg(float value)
 {
-	gl.Uniform1f(u_prog, value);
+	setFloatUniform(u_prog, value);
 }
 
 
@@ -562,7 +942,7 @@ SpriteShader::SpriteShader()
 
 void SpriteShader::setSpriteMat(const float value[16])
 {
-	gl.UniformMatrix4fv(u_spriteMat, 1, GL_FALSE, value);
+	setMatrixUniform(u_spriteMat, value);
 }
 
 void SpriteShader::setTone(const Vec4 &tone)
@@ -577,43 +957,43 @@ void SpriteShader::setColor(const Vec4 &color)
 
 void SpriteShader::setOpacity(float value)
 {
-	gl.Uniform1f(u_opacity, value);
+	setFloatUniform(u_opacity, value);
 }
 
 void SpriteShader::setBushDepth(float value)
 {
-	gl.Uniform1f(u_bushDepth, value);
+	setFloatUniform(u_bushDepth, value);
 }
 
 void SpriteShader::setBushOpacity(float value)
 {
-	gl.Uniform1f(u_bushOpacity, value);
+	setFloatUniform(u_bushOpacity, value);
 }
 
 void SpriteShader::setPattern(const TEX::ID pattern, const Vec2 &dimensions)
 {
     setTexUniform(u_pattern, 1, pattern);
-    gl.Uniform2f(u_patternSizeInv, 1.f / dimensions.x, 1.f / dimensions.y);
+    setVec2Uniform(u_patternSizeInv, Vec2(1.f / dimensions.x, 1.f / dimensions.y));
 }
 
 void SpriteShader::setPatternBlendType(int blendType)
 {
-    gl.Uniform1i(u_patternBlendType, blendType);
+    setIntUniform(u_patternBlendType, blendType);
 }
 
 void SpriteShader::setPatternTile(bool value)
 {
-    gl.Uniform1i(u_patternTile, value);
+    setIntUniform(u_patternTile, value);
 }
 
 void SpriteShader::setShouldRenderPattern(bool value)
 {
-    gl.Uniform1i(u_renderPattern, value);
+    setIntUniform(u_renderPattern, value);
 }
 
 void SpriteShader::setPatternOpacity(float value)
 {
-    gl.Uniform1f(u_patternOpacity, value);
+    setFloatUniform(u_patternOpacity, value);
 }
 
 void SpriteShader::setPatternScroll(const Vec2 &scroll)
@@ -628,7 +1008,7 @@ void SpriteShader::setPatternZoom(const Vec2 &zoom)
 
 void SpriteShader::setInvert(bool value)
 {
-    gl.Uniform1i(u_invert, value);
+    setIntUniform(u_invert, value);
 }
 
 
@@ -661,7 +1041,7 @@ void PlaneShader::setFlash(const Vec4 &flash)
 
 void PlaneShader::setOpacity(float value)
 {
-	gl.Uniform1f(u_opacity, value);
+	setFloatUniform(u_opacity, value);
 }
 
 
@@ -683,7 +1063,40 @@ bool GrayShader::framebufferScalingAllowed()
 
 void GrayShader::setGray(float value)
 {
-	gl.Uniform1f(u_gray, value);
+	setFloatUniform(u_gray, value);
+}
+
+
+ViewportShader::ViewportShader()
+{
+	INIT_SHADER(simple, viewport, ViewportShader);
+
+	ShaderBase::init();
+
+	GET_U(tone);
+	GET_U(color);
+	GET_U(flash);
+}
+
+bool ViewportShader::framebufferScalingAllowed()
+{
+	// Same as GrayShader, the frame is already scaled.
+	return false;
+}
+
+void ViewportShader::setTone(const Vec4 &value)
+{
+	setVec4Uniform(u_tone, value);
+}
+
+void ViewportShader::setColor(const Vec4 &value)
+{
+	setVec4Uniform(u_color, value);
+}
+
+void ViewportShader::setFlash(const Vec4 &value)
+{
+	setVec4Uniform(u_flash, value);
 }
 
 
@@ -713,17 +1126,18 @@ void TilemapShader::setColor(const Vec4 &color)
 
 void TilemapShader::setOpacity(float value)
 {
-	gl.Uniform1f(u_opacity, value);
+	setFloatUniform(u_opacity, value);
 }
 
 void TilemapShader::setAniIndex(int value)
 {
-	gl.Uniform1i(u_aniIndex, value);
+	setIntUniform(u_aniIndex, value);
 }
 
 void TilemapShader::setATFrames(int values[7])
 {
-	gl.Uniform1iv(u_atFrames, 7, values);
+	if (uniformChanged(u_atFrames, values, sizeof(int[7])))
+		gl.Uniform1iv(u_atFrames, 7, values);
 }
 
 
@@ -739,7 +1153,7 @@ FlashMapShader::FlashMapShader()
 
 void FlashMapShader::setAlpha(float value)
 {
-	gl.Uniform1f(u_alpha, value);
+	setFloatUniform(u_alpha, value);
 }
 
 
@@ -754,7 +1168,7 @@ HueShader::HueShader()
 
 void HueShader::setHueAdjust(float value)
 {
-	gl.Uniform1f(u_hueAdjust, value);
+	setFloatUniform(u_hueAdjust, value);
 }
 
 
@@ -769,7 +1183,7 @@ SimpleMatrixShader::SimpleMatrixShader()
 
 void SimpleMatrixShader::setMatrix(const float value[16])
 {
-	gl.UniformMatrix4fv(u_matrix, 1, GL_FALSE, value);
+	setMatrixUniform(u_matrix, value);
 }
 
 
@@ -799,7 +1213,7 @@ TilemapVXShader::TilemapVXShader()
 
 void TilemapVXShader::setAniOffset(const Vec2 &value)
 {
-	gl.Uniform2f(u_aniOffset, value.x, value.y);
+	setVec2Uniform(u_aniOffset, Vec2(value.x, value.y));
 }
 
 
@@ -817,7 +1231,7 @@ BltShader::BltShader()
 
 void BltShader::setSource()
 {
-	gl.Uniform1i(u_source, 0);
+	setIntUniform(u_source, 0);
 }
 
 void BltShader::setDestination(const TEX::ID value)
@@ -827,12 +1241,12 @@ void BltShader::setDestination(const TEX::ID value)
 
 void BltShader::setSubRect(const FloatRect &value)
 {
-	gl.Uniform4f(u_subRect, value.x, value.y, value.w, value.h);
+	setVec4Uniform(u_subRect, Vec4(value.x, value.y, value.w, value.h));
 }
 
 void BltShader::setOpacity(float value)
 {
-	gl.Uniform1f(u_opacity, value);
+	setFloatUniform(u_opacity, value);
 }
 
 BicubicShader::BicubicShader()
@@ -848,7 +1262,7 @@ BicubicShader::BicubicShader()
 
 void BicubicShader::setSharpness(int sharpness)
 {
-	gl.Uniform2f(u_bc, 1.f - sharpness * 0.01f, sharpness * 0.005f);
+	setVec2Uniform(u_bc, Vec2(1.f - sharpness * 0.01f, sharpness * 0.005f));
 }
 
 Lanczos3Shader::Lanczos3Shader()
@@ -864,7 +1278,7 @@ Lanczos3Shader::Lanczos3Shader()
 void Lanczos3Shader::setTexSize(const Vec2i &value)
 {
 	ShaderBase::setTexSize(value);
-	gl.Uniform2f(u_sourceSize, (float)value.x, (float)value.y);
+	setVec2Uniform(u_sourceSize, Vec2((float)value.x, (float)value.y));
 }
 
 #ifdef MKXPZ_SSL
@@ -881,6 +1295,36 @@ XbrzShader::XbrzShader()
 
 void XbrzShader::setTargetScale(const Vec2 &value)
 {
-	gl.Uniform2f(u_targetScale, value.x, value.y);
+	setVec2Uniform(u_targetScale, Vec2(value.x, value.y));
 }
 #endif
+
+template<class S>
+static bool warmUp(LazyShader<S> &shader)
+{
+	if (shader.isCompiled())
+		return false;
+
+	shader.get();
+
+	return true;
+}
+
+bool ShaderSet::warmUpNext()
+{
+	return warmUp(trans)
+	    || warmUp(simpleTrans)
+	    || warmUp(hue)
+	    || warmUp(textShadow)
+	    || warmUp(blur)
+	    || warmUp(obscured)
+	    || warmUp(bicubic)
+	    || warmUp(lanczos3)
+	    || warmUp(lanczos3Sprite)
+	    || warmUp(bicubicSprite)
+#ifdef MKXPZ_SSL
+	    || warmUp(xbrz)
+	    || warmUp(xbrzSprite)
+#endif
+	    ;
+}
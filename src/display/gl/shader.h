@@ -26,6 +26,11 @@
 #include "gl-util.h"
 #include "glstate.h"
 
+#include <string>
+#include <vector>
+
+struct Config;
+
 class Shader
 {
 public:
@@ -41,6 +46,16 @@ public:
     
     static std::string &commonHeader();
 
+	/* Uniform uploads skipped because the value was unchanged */
+	static unsigned long skippedUniformCount();
+
+	/* Loads the on-disk program binary cache, if enabled
+	 * and supported by the driver. Must be called before
+	 * any shader is initialized */
+	static void initBinaryCache(const Config &conf);
+	/* Writes back the cache if any program was added to it */
+	static void saveBinaryCache();
+
 protected:
 	Shader();
 	~Shader();
@@ -52,14 +67,36 @@ protected:
 	void initFromFile(const char *vertFile, const char *fragFile,
 	                  const char *programName);
 
-	static void setVec4Uniform(GLint location, const Vec4 &vec);
-    static void setVec2Uniform(GLint location, const Vec2 &vec);
-	static void setTexUniform(GLint location, unsigned unitIndex, TEX::ID texture);
+	/* Returns false (and counts a skipped call) if 'data' equals
+	 * what was last uploaded to 'location' in this program */
+	bool uniformChanged(GLint location, const void *data, size_t size);
+
+	void setFloatUniform(GLint location, float value);
+	void setIntUniform(GLint location, int value);
+	void setVec2Uniform(GLint location, const Vec2 &vec);
+	void setVec4Uniform(GLint location, const Vec4 &vec);
+	void setMatrixUniform(GLint location, const float value[16]);
+	void setTexUniform(GLint location, unsigned unitIndex, TEX::ID texture);
 
 	GLuint vertShader, fragShader;
 	GLuint program;
     
 private:
+	struct UniformShadow
+	{
+		bool valid;
+		/* Large enough for a mat4 */
+		unsigned char data[64];
+
+		UniformShadow()
+		    : valid(false)
+		{}
+	};
+
+	std::vector<UniformShadow> uniformShadow;
+
+	static unsigned long skippedUniforms;
+
 #ifdef MKXPZ_BUILD_XCODE
     static std::string shaderCommon;
 #endif
@@ -124,6 +161,18 @@ public:
 	SimpleColorShader();
 };
 
+class GlyphShader : public ShaderBase
+{
+public:
+	GlyphShader();
+};
+
+class TextShadowShader : public ShaderBase
+{
+public:
+	TextShadowShader();
+};
+
 class SimpleAlphaShader : public ShaderBase
 {
 public:
@@ -234,6 +283,24 @@ private:
 	GLint u_gray;
 };
 
+/* Applies a viewport's gray, tone, color and flash
+ * to the frame in a single pass */
+class ViewportShader : public ShaderBase
+{
+public:
+	ViewportShader();
+
+	void setTone(const Vec4 &value);
+	void setColor(const Vec4 &value);
+	void setFlash(const Vec4 &value);
+
+protected:
+	virtual bool framebufferScalingAllowed();
+
+private:
+	GLint u_tone, u_color, u_flash;
+};
+
 class TilemapShader : public ShaderBase
 {
 public:
@@ -410,6 +477,46 @@ protected:
 	GLint u_targetScale;
 };
 
+/* Compiles the wrapped shader on first access,
+ * for programs most games rarely or never use */
+template<class S>
+class LazyShader
+{
+public:
+	LazyShader()
+	    : shader(0)
+	{}
+
+	~LazyShader()
+	{
+		delete shader;
+	}
+
+	S &get()
+	{
+		if (!shader)
+			shader = new S();
+
+		return *shader;
+	}
+
+	operator S&()
+	{
+		return get();
+	}
+
+	bool isCompiled() const
+	{
+		return shader != 0;
+	}
+
+private:
+	LazyShader(const LazyShader&);
+	LazyShader &operator=(const LazyShader&);
+
+	S *shader;
+};
+
 /* Global object containing all available shaders */
 struct ShaderSet
 {
@@ -417,31 +524,38 @@ struct ShaderSet
 	SimpleShader simple;
 	SimpleColorShader simpleColor;
 	SimpleAlphaShader simpleAlpha;
+	GlyphShader glyph;
+	LazyShader<TextShadowShader> textShadow;
 	SimpleSpriteShader simpleSprite;
 	AlphaSpriteShader alphaSprite;
 	SpriteShader sprite;
 	PlaneShader plane;
 	GrayShader gray;
+	ViewportShader viewport;
 	TilemapShader tilemap;
 	FlashMapShader flashMap;
-	TransShader trans;
-	SimpleTransShader simpleTrans;
-	HueShader hue;
+	LazyShader<TransShader> trans;
+	LazyShader<SimpleTransShader> simpleTrans;
+	LazyShader<HueShader> hue;
 	BltShader blt;
 	SimpleMatrixShader simpleMatrix;
-	BlurShader blur;
+	LazyShader<BlurShader> blur;
 	TilemapVXShader tilemapVX;
-	ObscuredShader obscured;
-	BicubicShader bicubic;
-	Lanczos3Shader lanczos3;
+	LazyShader<ObscuredShader> obscured;
+	LazyShader<BicubicShader> bicubic;
+	LazyShader<Lanczos3Shader> lanczos3;
 #ifdef MKXPZ_SSL
-	XbrzShader xbrz;
+	LazyShader<XbrzShader> xbrz;
 #endif
-	Lanczos3SpriteShader lanczos3Sprite;
-	BicubicSpriteShader bicubicSprite;
+	LazyShader<Lanczos3SpriteShader> lanczos3Sprite;
+	LazyShader<BicubicSpriteShader> bicubicSprite;
 #ifdef MKXPZ_SSL
-	XbrzSpriteShader xbrzSprite;
+	LazyShader<XbrzSpriteShader> xbrzSprite;
 #endif
+
+	/* Compiles one of the lazy shaders that hasn't been
+	 * used yet. Returns false once none are left */
+	bool warmUpNext();
 };
 
 #endif // SHADER_H
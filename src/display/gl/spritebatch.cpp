@@ -0,0 +1,76 @@
+/*
+** spritebatch.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "spritebatch.h"
+
+#include "sharedstate.h"
+#include "glstate.h"
+#include "shader.h"
+#include "gpuprofiler.h"
+
+/* Keeps indices well within the 16 bit range of the global IBO */
+static const size_t maxBatchQuads = 4096;
+
+SpriteBatch::SpriteBatch()
+    : blendType(BlendNormal)
+{}
+
+void SpriteBatch::append(TEX::ID tex, const Vec2i &texSize,
+                         BlendType blendType, const SVertex vert[4])
+{
+	if (qArray.count() > 0 &&
+	    (tex != this->tex || blendType != this->blendType
+	     || qArray.count() >= maxBatchQuads))
+		flush();
+
+	this->tex = tex;
+	this->texSize = texSize;
+	this->blendType = blendType;
+
+	qArray.append(vert);
+}
+
+void SpriteBatch::flush()
+{
+	if (qArray.count() == 0)
+		return;
+
+	shState->gpuProfiler().setCategory(GPUProfiler::Sprites);
+
+	qArray.commit();
+
+	SimpleShader &shader = shState->shaders().simple;
+	shader.bind();
+	shader.applyViewportProj();
+	shader.setTranslation(Vec2i());
+	shader.setTexSize(texSize);
+
+	glState.blendMode.pushSet(blendType);
+
+	TEX::bind(tex);
+	TEX::setSmooth(false);
+
+	qArray.draw();
+
+	glState.blendMode.pop();
+
+	qArray.clear();
+}
@@ -0,0 +1,55 @@
+/*
+** spritebatch.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPRITEBATCH_H
+#define SPRITEBATCH_H
+
+#include "quadarray.h"
+#include "gl-util.h"
+#include "etc.h"
+#include "etc-internal.h"
+
+/* Collects plain textured quads (no color/tone effects, default
+ * filtering) that share a texture and blend mode, and draws them
+ * with a single call. Scene::composite flushes it whenever an
+ * element has to be drawn the regular way, so draw order is kept. */
+class SpriteBatch
+{
+public:
+	SpriteBatch();
+
+	/* Queues a quad whose positions are already in viewport
+	 * space; pending quads are flushed first if they use
+	 * a different texture or blend mode */
+	void append(TEX::ID tex, const Vec2i &texSize,
+	            BlendType blendType, const SVertex vert[4]);
+
+	void flush();
+
+private:
+	SimpleQuadArray qArray;
+
+	TEX::ID tex;
+	Vec2i texSize;
+	BlendType blendType;
+};
+
+#endif // SPRITEBATCH_H
@@ -71,6 +71,9 @@ struct TexPoolPrivate
 	/* Has this pool been disabled? */
 	bool disabled;
 
+	/* Holders beyond the first, per shared texture */
+	BoostHash<GLuint, int> sharers;
+
 	TexPoolPrivate(uint32_t maxMemSize)
 	    : maxMemSize(maxMemSize),
 	      memSize(0),
@@ -144,6 +147,17 @@ TEXFBO TexPool::request(int width, int height)
 
 void TexPool::release(TEXFBO &obj)
 {
+	if (p->sharers.contains(obj.tex.gl))
+	{
+		/* Someone else still uses it */
+		int &count = p->sharers[obj.tex.gl];
+
+		if (--count == 0)
+			p->sharers.remove(obj.tex.gl);
+
+		return;
+	}
+
 	if (obj.tex == TEX::ID(0) || obj.fbo == FBO::ID(0))
 	{
 		TEXFBO::fini(obj);
@@ -208,6 +222,19 @@ void TexPool::release(TEXFBO &obj)
 //	Debug() << "TexPool: <!+> (" << obj.width << obj.height << ") Current size:" << p->memSize;
 }
 
+void TexPool::retain(const TEXFBO &obj)
+{
+	if (obj.tex == TEX::ID(0))
+		return;
+
+	++p->sharers[obj.tex.gl];
+}
+
+bool TexPool::isShared(const TEXFBO &obj) const
+{
+	return p->sharers.contains(obj.tex.gl);
+}
+
 void TexPool::disable()
 {
 	p->disabled = true;
@@ -35,6 +35,14 @@ public:
 	TEXFBO request(int width, int height);
 	void release(TEXFBO &obj);
 
+	/* Adds a holder to 'obj'. Until every holder has
+	 * released it again, release() only drops one */
+	void retain(const TEXFBO &obj);
+
+	/* Whether more than one holder references 'obj'.
+	 * Shared textures must not be drawn to */
+	bool isShared(const TEXFBO &obj) const;
+
 	void disable();
 
 private:
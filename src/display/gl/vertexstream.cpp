@@ -0,0 +1,102 @@
+/*
+** vertexstream.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "vertexstream.h"
+
+#include "global-ibo.h"
+#include "sharedstate.h"
+
+#include <algorithm>
+#include <string.h>
+
+/* Initial size of the buffer storage */
+static const size_t streamSize = 2 * 1024 * 1024;
+
+VertexStream::VertexStream()
+    : capacity(0),
+      cursor(0),
+      gen(0)
+{
+	buffer = VBO::gen();
+	orphan(streamSize);
+	VBO::unbind();
+}
+
+VertexStream::~VertexStream()
+{
+	VBO::del(buffer);
+}
+
+void VertexStream::orphan(size_t size)
+{
+	VBO::bind(buffer);
+	VBO::allocEmpty(size, GL_STREAM_DRAW);
+
+	capacity = size;
+	cursor = 0;
+	++gen;
+}
+
+size_t VertexStream::upload(const void *data, size_t quadCount, size_t quadSize)
+{
+	size_t bytes = quadCount * quadSize;
+	size_t base = (cursor + quadSize - 1) / quadSize;
+
+	/* Stay within what the global IBO can address in one draw */
+	size_t maxQuads = shState->globalIBO().quadLimit();
+
+	if ((base + quadCount) * quadSize > capacity || base + quadCount > maxQuads)
+	{
+		orphan(std::max(capacity, bytes));
+		base = 0;
+	}
+	else
+	{
+		VBO::bind(buffer);
+	}
+
+	if (bytes == 0)
+		return base;
+
+	size_t offset = base * quadSize;
+	void *dst = 0;
+
+	/* Nothing queued can reference this range anymore,
+	 * so there is no need for the driver to synchronize */
+	if (gl.MapBufferRange)
+		dst = gl.MapBufferRange(GL_ARRAY_BUFFER, offset, bytes,
+		                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+		                        GL_MAP_UNSYNCHRONIZED_BIT);
+
+	if (dst)
+	{
+		memcpy(dst, data, bytes);
+		gl.UnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	else
+	{
+		VBO::uploadSubData(offset, bytes, data);
+	}
+
+	cursor = offset + bytes;
+
+	return base;
+}
@@ -0,0 +1,61 @@
+/*
+** vertexstream.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VERTEXSTREAM_H
+#define VERTEXSTREAM_H
+
+#include "gl-util.h"
+
+#include <stddef.h>
+
+/* One large vertex buffer that QuadArrays sub-allocate their data
+ * from. Uploads advance through the buffer; once it runs full (or
+ * quad indices would exceed the global IBO), its storage is orphaned
+ * and allocation restarts at the front. Regions that a queued draw
+ * may still read from are therefore never written to again, and the
+ * driver never has to stall on them. */
+class VertexStream
+{
+public:
+	VertexStream();
+	~VertexStream();
+
+	/* Copies 'quadCount' quads of 'quadSize' bytes each into the
+	 * stream and returns the index of the first one, counted in
+	 * units of 'quadSize'. Leaves the buffer bound */
+	size_t upload(const void *data, size_t quadCount, size_t quadSize);
+
+	VBO::ID vbo() const { return buffer; }
+
+	/* Increases every time the storage is orphaned; data
+	 * uploaded under an older generation has to be resent */
+	unsigned int generation() const { return gen; }
+
+private:
+	void orphan(size_t size);
+
+	VBO::ID buffer;
+	size_t capacity;
+	size_t cursor;
+	unsigned int gen;
+};
+
+#endif // VERTEXSTREAM_H
@@ -0,0 +1,424 @@
+/*
+** glyphatlas.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "glyphatlas.h"
+
+#include "quad.h"
+#include "quadarray.h"
+#include "shader.h"
+#include "glstate.h"
+#include "sharedstate.h"
+
+#include <SDL_surface.h>
+#include <SDL_ttf.h>
+
+#include <algorithm>
+#include <limits.h>
+#include <string.h>
+
+/* Larger than any text page needs, small enough for every GPU */
+static const int atlasSize = 1024;
+
+/* Decodes the next code point of 'str'. Fails on malformed
+ * input and anything outside the BMP, which SDL_ttf's 16 bit
+ * glyph functions can't address */
+static bool decodeUtf8(const char *&str, uint16_t &ch)
+{
+	const unsigned char *s = reinterpret_cast<const unsigned char*>(str);
+
+	if (s[0] < 0x80)
+	{
+		ch = s[0];
+		str += 1;
+		return true;
+	}
+
+	if ((s[0] & 0xE0) == 0xC0)
+	{
+		if ((s[1] & 0xC0) != 0x80)
+			return false;
+
+		ch = (s[0] & 0x1F) << 6 | (s[1] & 0x3F);
+		str += 2;
+		return true;
+	}
+
+	if ((s[0] & 0xF0) == 0xE0)
+	{
+		if ((s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80)
+			return false;
+
+		ch = (s[0] & 0x0F) << 12 | (s[1] & 0x3F) << 6 | (s[2] & 0x3F);
+		str += 3;
+		return true;
+	}
+
+	return false;
+}
+
+static void encodeUtf8(uint16_t ch, char out[4])
+{
+	if (ch < 0x80)
+	{
+		out[0] = ch;
+		out[1] = '\0';
+	}
+	else if (ch < 0x800)
+	{
+		out[0] = 0xC0 | (ch >> 6);
+		out[1] = 0x80 | (ch & 0x3F);
+		out[2] = '\0';
+	}
+	else
+	{
+		out[0] = 0xE0 | (ch >> 12);
+		out[1] = 0x80 | ((ch >> 6) & 0x3F);
+		out[2] = 0x80 | (ch & 0x3F);
+		out[3] = '\0';
+	}
+}
+
+/* Bounding box of the pixels with non-zero alpha */
+static IntRect findInk(SDL_Surface *surf)
+{
+	const SDL_PixelFormat &fm = *surf->format;
+
+	int x1 = surf->w, y1 = surf->h, x2 = -1, y2 = -1;
+
+	for (int y = 0; y < surf->h; ++y)
+	{
+		const uint32_t *row =
+			(const uint32_t*) ((const uint8_t*) surf->pixels + y*surf->pitch);
+
+		for (int x = 0; x < surf->w; ++x)
+		{
+			if (!(row[x] & fm.Amask))
+				continue;
+
+			x1 = std::min(x1, x);
+			x2 = std::max(x2, x);
+			y1 = std::min(y1, y);
+			y2 = std::max(y2, y);
+		}
+	}
+
+	if (x2 < 0)
+		return IntRect();
+
+	return IntRect(x1, y1, x2 - x1 + 1, y2 - y1 + 1);
+}
+
+bool GlyphAtlas::Key::operator<(const Key &o) const
+{
+	if (font != o.font)
+		return font < o.font;
+
+	if (style != o.style)
+		return style < o.style;
+
+	if (outline != o.outline)
+		return outline < o.outline;
+
+	return ch < o.ch;
+}
+
+GlyphAtlas::GlyphAtlas()
+    : size(0),
+      shelfBottom(0),
+      full(false),
+      quads(0)
+{}
+
+GlyphAtlas::~GlyphAtlas()
+{
+	delete quads;
+
+	if (tex.tex != TEX::ID(0))
+		TEXFBO::fini(tex);
+}
+
+bool GlyphAtlas::layout(_TTF_Font *font, const char *str, int outline, GlyphRun &run)
+{
+	chars.clear();
+
+	for (const char *s = str; *s;)
+	{
+		uint16_t ch;
+
+		if (!decodeUtf8(s, ch))
+			return false;
+
+		chars.push_back(ch);
+	}
+
+	if (chars.empty())
+		return false;
+
+	if (outline)
+		TTF_SetFontOutline(font, outline);
+
+	full = false;
+	bool ok = layoutChars(font, outline, run);
+
+	/* Start over with an empty atlas; the glyphs
+	 * of older runs aren't needed anymore */
+	if (!ok && full)
+	{
+		clear();
+		ok = layoutChars(font, outline, run);
+	}
+
+	/* Catch any difference in how SDL_ttf positions glyphs
+	 * within strings (eg. shaping) that the glyph metrics
+	 * don't account for */
+	if (ok)
+	{
+		int w, h;
+
+		if (TTF_SizeUTF8(font, str, &w, &h) != 0 || w != run.width || h != run.height)
+			ok = false;
+	}
+
+	if (outline)
+		TTF_SetFontOutline(font, 0);
+
+	return ok;
+}
+
+void GlyphAtlas::draw(const GlyphRun &run, const Vec2i &offset, const Vec4 &color)
+{
+	if (run.quads.empty())
+		return;
+
+	if (!quads)
+		quads = new QuadArray<Vertex>;
+
+	quads->clear();
+
+	for (size_t i = 0; i < run.quads.size(); ++i)
+	{
+		Vertex vert[4];
+		Quad::setTexPosRect(vert, run.quads[i].src, run.quads[i].dst);
+		Quad::setColor(vert, color);
+
+		quads->append(vert);
+	}
+
+	quads->commit();
+
+	GlyphShader &shader = shState->shaders().glyph;
+	shader.bind();
+	shader.applyViewportProj();
+	shader.setTexSize(Vec2i(tex.width, tex.height));
+	shader.setTranslation(offset);
+
+	TEX::bind(tex.tex);
+
+	glState.blend.pushSet(false);
+	quads->draw();
+	glState.blend.pop();
+}
+
+void GlyphAtlas::clear()
+{
+	glyphs.clear();
+	shelves.clear();
+	shelfBottom = 0;
+}
+
+bool GlyphAtlas::layoutChars(_TTF_Font *font, int outline, GlyphRun &run)
+{
+	run.quads.clear();
+
+	int pen = 0;
+	int minX = 0, maxX = 0, height = 0;
+	int inkRight = INT_MIN;
+
+	for (size_t i = 0; i < chars.size(); ++i)
+	{
+		if (i > 0)
+			pen += TTF_GetFontKerningSizeGlyphs(font, chars[i-1], chars[i]);
+
+		const Glyph *g = getGlyph(font, outline, chars[i]);
+
+		if (!g)
+			return false;
+
+		const int cellX = pen + g->cellX;
+
+		minX = std::min(minX, cellX);
+		maxX = std::max(maxX, cellX + g->cellW);
+		height = std::max(height, g->cellH);
+
+		pen += g->advance;
+
+		if (g->ink.w == 0)
+			continue;
+
+		const int inkX = cellX + g->ink.x;
+
+		/* SDL_ttf merges the coverage of overlapping glyphs
+		 * in a way blending can't reproduce */
+		if (inkX < inkRight)
+			return false;
+
+		inkRight = inkX + g->ink.w;
+
+		GlyphQuad quad;
+		quad.src = IntRect(g->atlasPos.x, g->atlasPos.y, g->ink.w, g->ink.h);
+		quad.dst = IntRect(inkX, g->ink.y, g->ink.w, g->ink.h);
+
+		run.quads.push_back(quad);
+	}
+
+	for (size_t i = 0; i < run.quads.size(); ++i)
+		run.quads[i].dst.x -= minX;
+
+	run.width = maxX - minX;
+	run.height = height;
+
+	return true;
+}
+
+const GlyphAtlas::Glyph *GlyphAtlas::getGlyph(_TTF_Font *font, int outline, uint16_t ch)
+{
+	Key key = { font, TTF_GetFontStyle(font), outline, ch };
+
+	if (glyphs.contains(key))
+		return &glyphs[key];
+
+	Glyph g;
+
+	if (!rasterise(font, ch, g))
+		return 0;
+
+	glyphs.insert(key, g);
+
+	return &glyphs[key];
+}
+
+bool GlyphAtlas::rasterise(_TTF_Font *font, uint16_t ch, Glyph &g)
+{
+	int minX, advance;
+
+	if (TTF_GlyphMetrics(font, ch, &minX, 0, 0, 0, &advance) != 0)
+		return false;
+
+	/* Render it as a one character string, so it goes
+	 * through the same code as whole strings do */
+	char str[4];
+	encodeUtf8(ch, str);
+
+	const SDL_Color white = { 255, 255, 255, 255 };
+	SDL_Surface *rendered = TTF_RenderUTF8_Blended(font, str, white);
+
+	if (!rendered)
+		return false;
+
+	SDL_Surface *surf = SDL_ConvertSurfaceFormat(rendered, SDL_PIXELFORMAT_ABGR8888, 0);
+	SDL_FreeSurface(rendered);
+
+	if (!surf)
+		return false;
+
+	g.cellX = std::min(0, minX);
+	g.cellW = surf->w;
+	g.cellH = surf->h;
+	g.advance = advance;
+	g.ink = findInk(surf);
+
+	if (g.ink.w == 0)
+	{
+		SDL_FreeSurface(surf);
+		return true;
+	}
+
+	if (!allocate(g.ink.w, g.ink.h, g.atlasPos))
+	{
+		SDL_FreeSurface(surf);
+		return false;
+	}
+
+	staging.resize(g.ink.w * g.ink.h);
+
+	for (int y = 0; y < g.ink.h; ++y)
+	{
+		const uint8_t *row = (const uint8_t*) surf->pixels + (g.ink.y + y)*surf->pitch;
+		memcpy(&staging[y*g.ink.w], row + g.ink.x*4, g.ink.w*4);
+	}
+
+	SDL_FreeSurface(surf);
+
+	TEX::bind(tex.tex);
+	TEX::uploadSubImage(g.atlasPos.x, g.atlasPos.y, g.ink.w, g.ink.h, &staging[0], GL_RGBA);
+
+	return true;
+}
+
+bool GlyphAtlas::allocate(int w, int h, Vec2i &pos)
+{
+	if (tex.tex == TEX::ID(0))
+	{
+		size = std::min(atlasSize, glState.caps.maxTexSize);
+
+		TEXFBO::init(tex);
+		TEXFBO::allocEmpty(tex, size, size);
+		TEXFBO::linkFBO(tex);
+	}
+
+	/* Keep a pixel between glyphs */
+	const int pw = w + 1;
+	const int ph = h + 1;
+
+	if (pw > size || ph > size)
+		return false;
+
+	for (size_t i = 0; i < shelves.size(); ++i)
+	{
+		Shelf &shelf = shelves[i];
+
+		/* Don't waste tall shelves on small glyphs */
+		if (ph > shelf.h || ph < shelf.h - shelf.h / 4)
+			continue;
+
+		if (shelf.x + pw > size)
+			continue;
+
+		pos = Vec2i(shelf.x, shelf.y);
+		shelf.x += pw;
+
+		return true;
+	}
+
+	if (shelfBottom + ph > size)
+	{
+		full = true;
+		return false;
+	}
+
+	Shelf shelf = { shelfBottom, ph, pw };
+	shelves.push_back(shelf);
+
+	pos = Vec2i(0, shelfBottom);
+	shelfBottom += ph;
+
+	return true;
+}
@@ -0,0 +1,135 @@
+/*
+** glyphatlas.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+
+#include "gl-util.h"
+#include "etc-internal.h"
+#include "boost-hash.h"
+
+#include <vector>
+#include <stdint.h>
+
+struct _TTF_Font;
+struct Vertex;
+template<class VertexType>
+struct QuadArray;
+
+struct GlyphQuad
+{
+	/* Glyph coverage in the atlas */
+	IntRect src;
+	/* Where it goes in the rendered string */
+	IntRect dst;
+};
+
+/* A string laid out from atlas glyphs. Positions are relative
+ * to the surface SDL_ttf would have rendered the string into,
+ * which is 'width' x 'height' large */
+struct GlyphRun
+{
+	std::vector<GlyphQuad> quads;
+	int width, height;
+
+	GlyphRun()
+	    : width(0), height(0)
+	{}
+};
+
+/* Keeps every glyph drawn so far, per font, style and outline
+ * size, as white coverage in one shared texture, so drawing a
+ * string only takes a quad per glyph instead of rendering and
+ * uploading the whole string again. Once the texture is full
+ * it is simply emptied and refilled by the following draws */
+class GlyphAtlas
+{
+public:
+	GlyphAtlas();
+	~GlyphAtlas();
+
+	/* Lays out the UTF-8 string 'str' as 'font' renders it with
+	 * the given outline size, rasterising missing glyphs. Returns
+	 * false if the result wouldn't match rendering the string as
+	 * a whole (eg. glyphs overlap); the caller has to do that then.
+	 * The run is only valid until the next layout() */
+	bool layout(_TTF_Font *font, const char *str, int outline, GlyphRun &run);
+
+	/* Draws 'run' offset by 'offset' into the bound framebuffer,
+	 * sized by the current viewport. The glyph coverage replaces
+	 * the destination alpha, tinted with the RGB of 'color' */
+	void draw(const GlyphRun &run, const Vec2i &offset, const Vec4 &color);
+
+	/* Drops all glyphs */
+	void clear();
+
+private:
+	struct Key
+	{
+		_TTF_Font *font;
+		int style;
+		int outline;
+		uint16_t ch;
+
+		bool operator<(const Key &o) const;
+	};
+
+	struct Glyph
+	{
+		/* Surface the glyph alone renders into, relative
+		 * to the pen position */
+		int cellX, cellW, cellH;
+		int advance;
+		/* Covered pixels within the cell, empty for blanks */
+		IntRect ink;
+		/* Position of 'ink' in the atlas */
+		Vec2i atlasPos;
+	};
+
+	struct Shelf
+	{
+		int y, h;
+		int x;
+	};
+
+	bool layoutChars(_TTF_Font *font, int outline, GlyphRun &run);
+	const Glyph *getGlyph(_TTF_Font *font, int outline, uint16_t ch);
+	bool rasterise(_TTF_Font *font, uint16_t ch, Glyph &g);
+	bool allocate(int w, int h, Vec2i &pos);
+
+	TEXFBO tex;
+	int size;
+
+	std::vector<Shelf> shelves;
+	int shelfBottom;
+
+	BoostHash<Key, Glyph> glyphs;
+
+	/* Set when a glyph didn't fit anymore */
+	bool full;
+
+	std::vector<uint16_t> chars;
+	std::vector<uint32_t> staging;
+
+	QuadArray<Vertex> *quads;
+};
+
+#endif // GLYPHATLAS_H
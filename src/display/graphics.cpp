@@ -32,13 +32,18 @@
 #include "etc-internal.h"
 #include "eventthread.h"
 #include "filesystem.h"
+#include "frameprofiler.h"
 #include "gl-fun.h"
 #include "gl-util.h"
 #include "glstate.h"
+#include "gpuprofiler.h"
 #include "intrulist.h"
 #include "quad.h"
 #include "scene.h"
+#include "screencapture.h"
+#include "imageloader.h"
 #include "shader.h"
+#include "sdl-util.h"
 #include "sharedstate.h"
 #include "texpool.h"
 #include "theoraplay/theoraplay.h"
@@ -495,7 +500,8 @@ private:
 
 class ScreenScene : public Scene {
 public:
-    ScreenScene(int width, int height) : pp(width, height) {
+    ScreenScene(int width, int height, FrameProfiler &profiler)
+    : pp(width, height), profiler(profiler), damaged(true) {
         updateReso(width, height);
         
         brightEffect = false;
@@ -506,7 +512,14 @@ public:
         const int w = geometry.rect.w;
         const int h = geometry.rect.h;
         
+        profiler.begin(FrameTiming::PrepareDraw);
         shState->prepareDraw();
+        profiler.end(FrameTiming::PrepareDraw);
+        
+        profiler.begin(FrameTiming::Composite);
+        
+        /* Changes made from here on are caught by the next frame */
+        damaged = false;
         
         pp.startRender();
         
@@ -514,8 +527,12 @@ public:
         
         FBO::clear();
         
+        shState->sceneStats() = SceneStats();
+        
         Scene::composite();
         
+        shState->gpuProfiler().setCategory(GPUProfiler::None);
+        
         if (brightEffect) {
             SimpleColorShader &shader = shState->shaders().simpleColor;
             shader.bind();
@@ -524,9 +541,54 @@ public:
             
             brightnessQuad.draw();
         }
+        
+        profiler.end(FrameTiming::Composite);
     }
     
     void requestViewportRender(const Vec4 &c, const Vec4 &f, const Vec4 &t) {
+        profiler.begin(FrameTiming::Effects);
+        shState->gpuProfiler().setCategory(GPUProfiler::ViewportEffects);
+        
+        renderViewportEffects(c, f, t);
+        
+        shState->gpuProfiler().setCategory(GPUProfiler::None);
+        profiler.end(FrameTiming::Effects);
+    }
+    
+    void renderViewportEffects(const Vec4 &c, const Vec4 &f, const Vec4 &t) {
+        const IntRect &screenRect = geometry.rect;
+        
+        /* Bring the viewport's area of the frame into the back buffer
+         * so it can be read while the result is written on top.
+         * The scissor test is still on, so the blit won't touch
+         * anything outside of it */
+        int scaleIsSpecial = GLMeta::blitScaleIsSpecial(pp.backBuffer(), false, screenRect, pp.frontBuffer(), screenRect);
+        
+        GLMeta::blitBegin(pp.backBuffer(), false, scaleIsSpecial);
+        GLMeta::blitSource(pp.frontBuffer(), scaleIsSpecial);
+        GLMeta::blitRectangle(screenRect, Vec2i());
+        GLMeta::blitEnd();
+        
+        pp.startRender();
+        
+        ViewportShader &shader = shState->shaders().viewport;
+        shader.bind();
+        shader.applyViewportProj();
+        shader.setTexSize(screenRect.size());
+        shader.setTone(t);
+        shader.setColor(c);
+        shader.setFlash(f);
+        
+        TEX::bind(pp.backBuffer().tex);
+        
+        glState.blend.pushSet(false);
+        screenQuad.draw();
+        glState.blend.pop();
+    }
+    
+    /* The previous way of rendering viewport effects, one
+     * pass per effect; only kept around for benchmarking */
+    void renderViewportEffectsMultiPass(const Vec4 &c, const Vec4 &f, const Vec4 &t) {
         const IntRect &viewpRect = glState.scissorBox.get();
         const IntRect &screenRect = geometry.rect;
         
@@ -629,10 +691,66 @@ public:
         glState.blendMode.refresh();
     }
     
+    ViewportEffectBenchmark benchmarkViewportEffects(int passes) {
+        const IntRect &screenRect = geometry.rect;
+        const uint64_t area = (uint64_t) screenRect.w * screenRect.h;
+        
+        /* All four effects at once, the worst case for the
+         * multi pass path */
+        const Vec4 color(1, 0, 0, 0.25f);
+        const Vec4 flash(1, 1, 1, 0.5f);
+        const Vec4 tone(0.2f, -0.2f, 0.1f, 0.5f);
+        
+        ViewportEffectBenchmark result;
+        
+        pp.startRender();
+        glState.viewport.set(screenRect);
+        glState.scissorTest.pushSet(true);
+        glState.scissorBox.pushSet(screenRect);
+        
+        /* Make sure both shader programs are ready */
+        renderViewportEffects(color, flash, tone);
+        renderViewportEffectsMultiPass(color, flash, tone);
+        gl.Finish();
+        
+        uint64_t start = SDL_GetPerformanceCounter();
+        
+        for (int i = 0; i < passes; ++i)
+            renderViewportEffects(color, flash, tone);
+        
+        gl.Finish();
+        uint64_t mid = SDL_GetPerformanceCounter();
+        
+        for (int i = 0; i < passes; ++i)
+            renderViewportEffectsMultiPass(color, flash, tone);
+        
+        gl.Finish();
+        uint64_t end = SDL_GetPerformanceCounter();
+        
+        glState.scissorBox.pop();
+        glState.scissorTest.pop();
+        
+        const double msPerTick = 1000.0 / SDL_GetPerformanceFrequency();
+        
+        result.fusedMs = (mid - start) * msPerTick / passes;
+        result.multiPassMs = (end - mid) * msPerTick / passes;
+        
+        /* Copy into the back buffer, then one pass */
+        result.fusedFill = area * 2;
+        /* Gray, additive tone, subtractive tone, color, flash */
+        result.multiPassFill = area * 5;
+        
+        /* The frame in the buffers is garbage now */
+        damaged = true;
+        
+        return result;
+    }
+    
     void setBrightness(float norm) {
         brightnessQuad.setColor(Vec4(0, 0, 0, 1.0f - norm));
         
         brightEffect = norm < 1.0f;
+        damaged = true;
     }
     
     void updateReso(int width, int height) {
@@ -643,6 +761,23 @@ public:
         brightnessQuad.setTexPosRect(geometry.rect, geometry.rect);
         
         notifyGeometryChange();
+        damaged = true;
+    }
+    
+    void onContentChange() {
+        damaged = true;
+    }
+    
+    /* Force a full composite on the next frame, eg.
+     * after the screen buffers were written to directly */
+    void invalidate() {
+        damaged = true;
+    }
+    
+    /* Whether the front buffer might no longer match
+     * what compositing the scene would produce */
+    bool isDamaged() {
+        return damaged || !contentChangesTracked();
     }
     
     void setResolution(int width, int height) {
@@ -658,11 +793,21 @@ private:
     
     Quad brightnessQuad;
     bool brightEffect;
+    
+    FrameProfiler &profiler;
+    
+    bool damaged;
 };
 
+/* Frames before idle time is spent compiling shaders */
+#define SHADER_WARMUP_DELAY 300
+
 /* Nanoseconds per second */
 #define NS_PER_S 1000000000
 
+/* Frames kept for frame pacing statistics */
+#define PACING_HISTORY 120
+
 struct FPSLimiter {
     uint64_t lastTickCount;
     
@@ -680,6 +825,29 @@ struct FPSLimiter {
     
     bool disabled;
     
+    /* Sleep until shortly before the frame is due,
+     * then spin for the rest */
+    bool precise;
+    
+    struct {
+        /* Ticks before the deadline at which sleeping stops */
+        int64_t margin;
+        
+        /* Running average of how many ticks sleeps overshoot */
+        double oversleep;
+    } spin;
+    
+    /* Frame intervals for jitter statistics */
+    struct {
+        std::vector<uint64_t> intervals;
+        std::vector<bool> missed;
+        size_t next;
+        size_t count;
+        
+        uint64_t totalMissed;
+        uint64_t lastFrame;
+    } pacing;
+    
     /* Data for frame timing adjustment */
     struct {
         /* Last tick count */
@@ -694,33 +862,52 @@ struct FPSLimiter {
     FPSLimiter(uint16_t desiredFPS)
     : lastTickCount(SDL_GetPerformanceCounter()),
     tickFreq(SDL_GetPerformanceFrequency()), tickFreqMS(tickFreq / 1000),
-    tickFreqNS((double)tickFreq / NS_PER_S), disabled(false) {
+    tickFreqNS((double)tickFreq / NS_PER_S), disabled(false), precise(false) {
         setDesiredFPS(desiredFPS);
         
         adj.last = SDL_GetPerformanceCounter();
         adj.idealDiff = 0;
         adj.resetFlag = false;
+        
+        spin.margin = tickFreqMS;
+        spin.oversleep = tickFreqMS / 2;
+        
+        pacing.intervals.resize(PACING_HISTORY);
+        pacing.missed.resize(PACING_HISTORY);
+        pacing.next = pacing.count = 0;
+        pacing.totalMissed = 0;
+        pacing.lastFrame = 0;
     }
     
     void setDesiredFPS(uint16_t value) { tpf = tickFreq / value; }
     
     void delay() {
-        if (disabled)
+        if (disabled) {
+            /* Still worth knowing how smooth vsync is */
+            recordFrame(SDL_GetPerformanceCounter(), false);
             return;
+        }
         
-        int64_t tickDelta = SDL_GetPerformanceCounter() - lastTickCount;
-        int64_t toDelay = tpf - tickDelta;
+        uint64_t start = SDL_GetPerformanceCounter();
+        int64_t tickDelta = start - lastTickCount;
         
         /* Compensate for the last delta
          * to the ideal timestep */
-        toDelay -= adj.idealDiff;
+        int64_t idealDelay = tpf - tickDelta - adj.idealDiff;
         
-        if (toDelay < 0)
-            toDelay = 0;
+        /* Where the frame should have ended; in the past
+         * already if it's running late */
+        int64_t deadline = (int64_t) start + idealDelay;
+        int64_t toDelay = std::max<int64_t>(idealDelay, 0);
         
-        delayTicks(toDelay);
+        if (precise)
+            delayUntil(start + toDelay);
+        else
+            delayTicks(toDelay);
         
         uint64_t now = lastTickCount = SDL_GetPerformanceCounter();
+        
+        recordFrame(now, (int64_t) now > deadline + (int64_t) tickFreqMS);
         int64_t diff = now - adj.last;
         adj.last = now;
         
@@ -736,6 +923,17 @@ struct FPSLimiter {
     
     void resetFrameAdjust() { adj.resetFlag = true; }
     
+    /* Whether more than half a frame's worth of
+     * ticks is left before the next frame is due */
+    bool hasIdleTime() const {
+        if (disabled)
+            return false;
+        
+        int64_t tickDelta = SDL_GetPerformanceCounter() - lastTickCount;
+        
+        return tpf - tickDelta - adj.idealDiff > tpf / 2;
+    }
+    
     /* If we're more than a full frame's worth
      * of ticks behind the ideal timestep,
      * there's no choice but to skip frame(s)
@@ -747,7 +945,79 @@ struct FPSLimiter {
         return adj.idealDiff > tpf;
     }
     
+    void stats(FramePacingStats &out) const {
+        const double tickMS = tickFreqMS;
+        
+        out.frames = pacing.count;
+        out.meanMs = out.variance = out.minMs = out.maxMs = 0;
+        out.missed = 0;
+        out.totalMissed = pacing.totalMissed;
+        out.spinMarginMs = precise ? spin.margin / tickMS : 0;
+        out.oversleepMs = precise ? spin.oversleep / tickMS : 0;
+        
+        if (pacing.count == 0)
+            return;
+        
+        double sum = 0, sumSq = 0;
+        out.minMs = pacing.intervals[0] / tickMS;
+        
+        for (size_t i = 0; i < pacing.count; ++i) {
+            double ms = pacing.intervals[i] / tickMS;
+            
+            sum += ms;
+            sumSq += ms * ms;
+            out.minMs = std::min(out.minMs, ms);
+            out.maxMs = std::max(out.maxMs, ms);
+            
+            if (pacing.missed[i])
+                ++out.missed;
+        }
+        
+        out.meanMs = sum / pacing.count;
+        out.variance = std::max(sumSq / pacing.count - out.meanMs * out.meanMs, 0.0);
+    }
+    
 private:
+    void recordFrame(uint64_t now, bool missed) {
+        if (pacing.lastFrame) {
+            pacing.intervals[pacing.next] = now - pacing.lastFrame;
+            pacing.missed[pacing.next] = missed;
+            pacing.next = (pacing.next + 1) % PACING_HISTORY;
+            
+            if (pacing.count < PACING_HISTORY)
+                ++pacing.count;
+            
+            if (missed)
+                ++pacing.totalMissed;
+        }
+        
+        pacing.lastFrame = now;
+    }
+    
+    /* SDL_Delay and nanosleep routinely wake up a millisecond
+     * or more late, which shows as frame time jitter. Sleep
+     * through most of the wait and spin through the rest,
+     * leaving as much to spin as sleeps tend to overshoot */
+    void delayUntil(uint64_t deadline) {
+        int64_t remaining = deadline - SDL_GetPerformanceCounter();
+        
+        if (remaining > spin.margin) {
+            uint64_t toSleep = remaining - spin.margin;
+            uint64_t before = SDL_GetPerformanceCounter();
+            
+            delayTicks(toSleep);
+            
+            int64_t over = (int64_t) (SDL_GetPerformanceCounter() - before) - (int64_t) toSleep;
+            
+            spin.oversleep += (std::max<int64_t>(over, 0) - spin.oversleep) * 0.1;
+            spin.margin = clamp<int64_t>(spin.oversleep * 1.5 + tickFreqMS / 4,
+                                         tickFreqMS / 4, tickFreqMS * 4);
+        }
+        
+        while ((int64_t) (deadline - SDL_GetPerformanceCounter()) > 0)
+            ;
+    }
+    
     void delayTicks(uint64_t ticks) {
 #if defined(HAVE_NANOSLEEP) && defined(MKXPZ_NANOSLEEP)
         struct timespec req;
@@ -796,6 +1066,7 @@ struct GraphicsPrivate {
     // on Retina displays
     int scalingFactor;
     
+    FrameProfiler profiler;
     ScreenScene screen;
     RGSSThreadData *threadData;
     SDL_GLContext glCtx;
@@ -830,25 +1101,60 @@ struct GraphicsPrivate {
     SDL_mutex *glResourceLock;
     bool multithreadedMode;
     
+    /* Thread holding glResourceLock, and how many times */
+    SDL_threadID lockOwner;
+    int lockDepth;
+    
+    /* Pipelined rendering: the RGSS thread composites each frame,
+     * then hands it to this thread to scale into the window, pace
+     * and swap while the next frame's game logic runs. Both share
+     * the one GL context, passing it along with glResourceLock */
+    struct {
+        SDL_Thread *thread;
+        SDL_threadID id;
+        SDL_mutex *mutex;
+        SDL_cond *cond;
+        
+        /* A frame is handed over and not yet done */
+        AtomicFlag busy;
+        
+        /* Show it, or only pace */
+        bool present;
+        bool quit;
+    } presenter;
+    
     /* Global list of all live Disposables
      * (disposed on reset) */
     IntruList<Disposable> dispList;
     
     TEX::ID obscuredTex;
     
+    ScreenCapture capture;
+    
+    /* Frames left until unused shaders get compiled
+     * in the background, keeping startup (usually the
+     * title screen) free of the extra work */
+    int warmUpDelay;
+    bool shadersWarm;
+    
+    /* Nothing is presented to a window */
+    bool headless;
+    
     GraphicsPrivate(RGSSThreadData *rtData)
     : scResLores(DEF_SCREEN_W, DEF_SCREEN_H),
     scRes(rtData->config.enableHires ? (int)lround(rtData->config.framebufferScalingFactor * DEF_SCREEN_W) : DEF_SCREEN_W,
         rtData->config.enableHires ? (int)lround(rtData->config.framebufferScalingFactor * DEF_SCREEN_H) : DEF_SCREEN_H),
     scSize(scRes),
     winSize(rtData->config.defScreenW, rtData->config.defScreenH),
-    screen(scRes.x, scRes.y), threadData(rtData),
-    glCtx(SDL_GL_GetCurrentContext()), multithreadedMode(true),
+    profiler(rtData->config), screen(scRes.x, scRes.y, profiler), threadData(rtData),
+    glCtx(SDL_GL_GetCurrentContext()), multithreadedMode(true), lockOwner(0), lockDepth(0),
     frameRate(DEF_FRAMERATE), frameCount(0), brightness(255),
     fpsLimiter(frameRate), useFrameSkip(rtData->config.frameSkip), frozen(false),
     last_update(0), last_avg_update(0), backingScaleFactor(1), integerScaleFactor(0, 0),
     integerScaleActive(rtData->config.integerScaling.active),
-    integerLastMileScaling(rtData->config.integerScaling.lastMileScaling) {
+    integerLastMileScaling(rtData->config.integerScaling.lastMileScaling),
+    warmUpDelay(SHADER_WARMUP_DELAY), shadersWarm(false),
+    headless(rtData->config.headless) {
         avgFPSData = std::vector<double>();
         avgFPSLock = SDL_CreateMutex();
         glResourceLock = SDL_CreateMutex();
@@ -870,6 +1176,14 @@ struct GraphicsPrivate {
         
         fpsLimiter.resetFrameAdjust();
         
+        presenter.thread = 0;
+        presenter.id = 0;
+        presenter.present = false;
+        presenter.quit = false;
+        
+        if (rtData->config.pipelinedRendering && !headless)
+            startPresenter();
+        
         obscuredTex = TEX::gen();
         TEX::bind(obscuredTex);
         TEX::setRepeat(false);
@@ -882,6 +1196,8 @@ struct GraphicsPrivate {
     }
     
     ~GraphicsPrivate() {
+        stopPresenter();
+        
         TEXFBO::fini(frozenScene);
         TEXFBO::fini(integerScaleBuffer);
         SDL_DestroyMutex(avgFPSLock);
@@ -900,6 +1216,9 @@ struct GraphicsPrivate {
     void recalculateScreenSize(bool fixedAspectRatio) {
         scSize = winSize;
         
+        /* The present step changes, so draw a fresh frame */
+        screen.invalidate();
+        
         if (!fixedAspectRatio) {
             if (!integerScaleActive || (integerScaleActive && integerLastMileScaling)) {
                 scOffset = Vec2i(0, 0);
@@ -1011,15 +1330,81 @@ struct GraphicsPrivate {
         scriptBinding->terminate();
     }
     
-    void swapGLBuffer() {
+    void swapGLBuffer(bool present = true) {
+        const bool onPresenter = presenting();
+        
+        if (!onPresenter)
+            waitPresent();
+        
+        endPhase(FrameTiming::Blit);
+        shState->gpuProfiler().endFrame();
+        
+        warmUpShaders();
+        
+        beginPhase(FrameTiming::Limiter);
+        
+        /* Let the RGSS thread at GL while we wait */
+        if (onPresenter)
+            releaseLock(true);
+        
         fpsLimiter.delay();
-        SDL_GL_SwapWindow(threadData->window);
+        
+        if (onPresenter)
+            setLock(true);
+        
+        endPhase(FrameTiming::Limiter);
+        
+        beginPhase(FrameTiming::Swap);
+        
+        if (!headless && present)
+            SDL_GL_SwapWindow(threadData->window);
+        
+        endPhase(FrameTiming::Swap);
+        
+        /* Counted when it was handed over */
+        if (onPresenter)
+            return;
         
         ++frameCount;
         
         threadData->ethread->notifyFrame();
     }
     
+    /* The frame profiler times the RGSS thread's frames only */
+    void beginPhase(FrameTiming::Phase phase) {
+        if (!presenting())
+            profiler.begin(phase);
+    }
+    
+    void endPhase(FrameTiming::Phase phase) {
+        if (!presenting())
+            profiler.end(phase);
+    }
+    
+    /* Spends idle frame time compiling the shaders
+     * that haven't been needed yet, one per frame */
+    void warmUpShaders() {
+        if (shadersWarm)
+            return;
+        
+        if (warmUpDelay > 0) {
+            --warmUpDelay;
+            return;
+        }
+        
+        if (!fpsLimiter.hasIdleTime())
+            return;
+        
+        if (!shState->shaders().warmUpNext()) {
+            shadersWarm = true;
+            Shader::saveBinaryCache();
+            
+            /* Nothing left to compile */
+            if (gl.ReleaseShaderCompiler)
+                gl.ReleaseShaderCompiler();
+        }
+    }
+    
     void compositeToBuffer(TEXFBO &buffer) {
         compositeToBufferScaled(buffer, scRes.x, scRes.y);
     }
@@ -1053,6 +1438,8 @@ struct GraphicsPrivate {
     }
     
     void redrawScreen() {
+        waitPresent();
+        
         if (shState->oneshot().obscuredDirty) {
             TEX::bind(obscuredTex);
 #ifdef GLES2_HEADER
@@ -1061,9 +1448,41 @@ struct GraphicsPrivate {
             TEX::uploadSubImage(0, 0, 640, 480, shState->oneshot().obscuredMap().data(), GL_RED);
 #endif
             shState->oneshot().obscuredDirty = false;
+            screen.invalidate();
         }
         
-        screen.composite();
+        /* If nothing changed, the front buffer still holds
+         * this frame; with vsync off the window does too, so
+         * there's nothing to present either */
+        bool present = true;
+        
+        if (screen.isDamaged())
+            screen.composite();
+        else if (!threadData->config.vsync && !threadData->config.syncToRefreshrate)
+            present = false;
+        
+        if (presenter.thread)
+            submitPresent(present);
+        else
+            presentScreen(present);
+    }
+    
+    /* Scales the composited frame into the window and swaps */
+    void presentScreen(bool present) {
+        if (!present) {
+            swapGLBuffer(false);
+            updateAvgFPS();
+            return;
+        }
+        
+        /* The frame stays in the screen's FBO */
+        if (headless) {
+            swapGLBuffer();
+            return;
+        }
+        
+        beginPhase(FrameTiming::Blit);
+        shState->gpuProfiler().setCategory(GPUProfiler::Present);
         
         // maybe unspaghetti this later
         if (integerScaleStepApplicable() && !integerLastMileScaling)
@@ -1158,17 +1577,137 @@ struct GraphicsPrivate {
     }
     
     void setLock(bool force = false) {
-        if (!(force || multithreadedMode)) return;
+        if (!(force || multithreadedMode || presenter.thread)) return;
         
         SDL_LockMutex(glResourceLock);
         SDL_GL_MakeCurrent(threadData->window, threadData->glContext);
+        
+        lockOwner = SDL_ThreadID();
+        ++lockDepth;
     }
     
     void releaseLock(bool force = false) {
-        if (!(force || multithreadedMode)) return;
+        if (!(force || multithreadedMode || presenter.thread)) return;
+        
+        if (--lockDepth == 0) {
+            lockOwner = 0;
+            
+            /* A context can only be current on one thread,
+             * and the other one might take it next */
+            if (presenter.busy)
+                SDL_GL_MakeCurrent(threadData->window, 0);
+        }
         
         SDL_UnlockMutex(glResourceLock);
     }
+    
+    bool presenting() const {
+        return presenter.thread && SDL_ThreadID() == presenter.id;
+    }
+    
+    void startPresenter() {
+        presenter.mutex = SDL_CreateMutex();
+        presenter.cond = SDL_CreateCond();
+        presenter.thread = createSDLThread
+            <GraphicsPrivate, &GraphicsPrivate::presentLoop>(this, "present");
+        
+        if (!presenter.thread) {
+            Debug() << "Failed to start the present thread:" << SDL_GetError();
+            
+            SDL_DestroyCond(presenter.cond);
+            SDL_DestroyMutex(presenter.mutex);
+            return;
+        }
+        
+        presenter.id = SDL_GetThreadID(presenter.thread);
+    }
+    
+    void stopPresenter() {
+        if (!presenter.thread)
+            return;
+        
+        waitPresent();
+        
+        SDL_LockMutex(presenter.mutex);
+        presenter.quit = true;
+        SDL_CondSignal(presenter.cond);
+        SDL_UnlockMutex(presenter.mutex);
+        
+        SDL_WaitThread(presenter.thread, 0);
+        presenter.thread = 0;
+        
+        SDL_DestroyCond(presenter.cond);
+        SDL_DestroyMutex(presenter.mutex);
+    }
+    
+    void presentLoop() {
+        SDL_LockMutex(presenter.mutex);
+        
+        while (true) {
+            while (!presenter.busy && !presenter.quit)
+                SDL_CondWait(presenter.cond, presenter.mutex);
+            
+            if (presenter.quit)
+                break;
+            
+            const bool present = presenter.present;
+            SDL_UnlockMutex(presenter.mutex);
+            
+            setLock(true);
+            presentScreen(present);
+            releaseLock(true);
+            
+            SDL_LockMutex(presenter.mutex);
+            presenter.busy.clear();
+            SDL_CondBroadcast(presenter.cond);
+        }
+        
+        SDL_UnlockMutex(presenter.mutex);
+    }
+    
+    /* Hands the composited frame to the presenter; the
+     * screen's front buffer must stay untouched until
+     * waitPresent() returns */
+    void submitPresent(bool present) {
+        ++frameCount;
+        threadData->ethread->notifyFrame();
+        
+        SDL_LockMutex(presenter.mutex);
+        presenter.present = present;
+        presenter.busy.set();
+        SDL_CondSignal(presenter.cond);
+        SDL_UnlockMutex(presenter.mutex);
+        
+        /* Otherwise let go of the context when unlocking */
+        if (lockOwner != SDL_ThreadID())
+            SDL_GL_MakeCurrent(threadData->window, 0);
+    }
+    
+    /* Waits for the frame in flight to be presented. Any
+     * GL lock held is passed on meanwhile, as the presenter
+     * needs it to finish */
+    void waitPresent() {
+        if (!presenter.busy || presenting())
+            return;
+        
+        const int depth = (lockOwner == SDL_ThreadID()) ? lockDepth : 0;
+        
+        for (int i = 0; i < depth; ++i)
+            releaseLock(true);
+        
+        SDL_LockMutex(presenter.mutex);
+        
+        while (presenter.busy)
+            SDL_CondWait(presenter.cond, presenter.mutex);
+        
+        SDL_UnlockMutex(presenter.mutex);
+        
+        for (int i = 0; i < depth; ++i)
+            setLock(true);
+        
+        if (depth == 0)
+            SDL_GL_MakeCurrent(threadData->window, threadData->glContext);
+    }
 
     void updateAvgFPS() {
         SDL_LockMutex(avgFPSLock);
@@ -1192,6 +1731,12 @@ Graphics::Graphics(RGSSThreadData *data) {
     } else if (data->config.fixedFramerate < 0) {
         p->fpsLimiter.disabled = true;
     }
+    
+    /* Run as fast as possible */
+    if (data->config.headless)
+        p->fpsLimiter.disabled = true;
+    
+    p->fpsLimiter.precise = data->config.preciseFramePacing;
 }
 
 Graphics::~Graphics() { delete p; }
@@ -1205,6 +1750,9 @@ double Graphics::lastUpdate() {
 }
 
 void Graphics::update(bool checkForShutdown) {
+    /* At most one frame is in flight */
+    p->waitPresent();
+    
     p->threadData->rqWindowAdjust.wait();
     p->last_update = shState->runTime();
     
@@ -1231,12 +1779,17 @@ void Graphics::update(bool checkForShutdown) {
     if (p->frozen)
         return;
     
+    p->profiler.beginFrame(p->frameCount);
+    
     if (p->fpsLimiter.frameSkipRequired()) {
         if (p->useFrameSkip) {
             /* Skip frame */
+            p->profiler.begin(FrameTiming::Limiter);
             p->fpsLimiter.delay();
+            p->profiler.end(FrameTiming::Limiter);
             ++p->frameCount;
             p->threadData->ethread->notifyFrame();
+            p->profiler.endFrame();
             
             return;
         } else {
@@ -1249,9 +1802,15 @@ void Graphics::update(bool checkForShutdown) {
     
     p->checkResize();
     p->redrawScreen();
+    
+    p->capture.update();
+    shState->imageLoader().update(shState->config().imageUploadBudget);
+    
+    p->profiler.endFrame();
 }
 
 void Graphics::freeze() {
+    p->waitPresent();
     p->frozen = true;
     
     p->checkShutDownReset();
@@ -1262,6 +1821,7 @@ void Graphics::freeze() {
 }
 
 void Graphics::transition(int duration, const char *filename, int vague) {
+    p->waitPresent();
     p->checkSyncLock();
     
     if (!p->frozen)
@@ -1346,6 +1906,8 @@ void Graphics::transition(int duration, const char *filename, int vague) {
         if (p->threadData->exiting)
             SDL_SetWindowOpacity(p->threadData->window, 1.0f - prog);
         
+        shState->gpuProfiler().setCategory(GPUProfiler::Transition);
+        
         /* Draw the composed frame to a buffer first
          * (we need this because we're skipping PingPong) */
         FBO::bind(transBuffer.fbo);
@@ -1372,12 +1934,18 @@ void Graphics::transition(int duration, const char *filename, int vague) {
     
     glState.blend.pop();
     
+    /* The window still shows the last transition step */
+    p->screen.invalidate();
+    
     delete transMap;
     
     p->frozen = false;
 }
 
-void Graphics::frameReset() {p->fpsLimiter.resetFrameAdjust();}
+void Graphics::frameReset() {
+    p->waitPresent();
+    p->fpsLimiter.resetFrameAdjust();
+}
 
 static void guardDisposed() {}
 
@@ -1386,6 +1954,7 @@ DEF_ATTR_RD_SIMPLE(Graphics, FrameRate, int, p->frameRate)
 DEF_ATTR_SIMPLE(Graphics, FrameCount, int, p->frameCount)
 
 void Graphics::setFrameRate(int value) {
+    p->waitPresent();
     p->frameRate = clamp(value, 10, 120);
     
     if (p->threadData->config.syncToRefreshrate)
@@ -1398,6 +1967,10 @@ void Graphics::setFrameRate(int value) {
     //shState->input().recalcRepeat((unsigned int)p->frameRate);
 }
 
+void Graphics::frameStats(std::vector<FrameTiming> &out) const {
+    p->profiler.history(out);
+}
+
 double Graphics::averageFrameRate() {
     return p->averageFPS();
 }
@@ -1410,6 +1983,7 @@ void Graphics::wait(int duration) {
 }
 
 void Graphics::fadeout(int duration) {
+    p->waitPresent();
     FBO::unbind();
     
     float curr = p->brightness;
@@ -1437,6 +2011,7 @@ void Graphics::fadeout(int duration) {
 }
 
 void Graphics::fadein(int duration) {
+    p->waitPresent();
     FBO::unbind();
     
     float curr = p->brightness;
@@ -1464,6 +2039,8 @@ void Graphics::fadein(int duration) {
 }
 
 Bitmap *Graphics::snapToBitmap() {
+    /* The front buffer may still be on its way to the window */
+    p->waitPresent();
     p->screen.composite();
 
     if (shState->config().enableHires) {
@@ -1565,6 +2142,8 @@ bool Graphics::updateMovieInput(Movie *movie) {
 }
 
 void Graphics::playMovie(const char *filename, int volume_, bool skippable) {
+    p->waitPresent();
+    
     if (shState->config().enableHires) {
         Debug() << "BUG: High-res Graphics playMovie not implemented";
     }
@@ -1609,6 +2188,21 @@ void Graphics::screenshot(const char *filename) {
 
 DEF_ATTR_RD_SIMPLE(Graphics, Brightness, int, p->brightness)
 
+int Graphics::screenshotAsync(const char *filename) {
+    p->waitPresent();
+    p->threadData->rqWindowAdjust.wait();
+    
+    p->screen.composite();
+    
+    std::string path = shState->fileSystem().normalize(filename, 1, 1);
+    
+    return p->capture.request(p->screen.getPP().frontBuffer(), path);
+}
+
+void Graphics::finishedScreenshots(std::vector<CaptureResult> &out) {
+    p->capture.takeFinished(out);
+}
+
 void Graphics::setBrightness(int value) {
     value = clamp(value, 0, 255);
     
@@ -1631,9 +2225,11 @@ void Graphics::reset() {
     p->dispList.clear();
     
     /* Reset attributes (frame count not included) */
+    p->waitPresent();
     p->fpsLimiter.resetFrameAdjust();
     p->frozen = false;
     p->screen.getPP().clearBuffers();
+    p->screen.invalidate();
     
     setFrameRate(DEF_FRAMERATE);
     setBrightness(255);
@@ -1690,6 +2286,8 @@ void Graphics::setSmooth(bool value)
         shState->config().smoothScaling = 1; // Bilinear
     else
         shState->config().smoothScaling = 0; // Nearest-Neighbor
+    
+    p->screen.invalidate();
 }
 
 int Graphics::getSmoothScaling() const
@@ -1701,6 +2299,7 @@ int Graphics::getSmoothScaling() const
 void Graphics::setSmoothScaling(int value)
 {
     shState->config().smoothScaling = value;
+    p->screen.invalidate();
 }
 
 bool Graphics::getIntegerScaling() const
@@ -1763,12 +2362,23 @@ bool Graphics::getFrameskip() const { return p->useFrameSkip; }
 
 void Graphics::setFrameskip(bool value) { p->useFrameSkip = value; }
 
+void Graphics::pacingStats(FramePacingStats &out) const {
+    p->waitPresent();
+    p->fpsLimiter.stats(out);
+}
+
+ViewportEffectBenchmark Graphics::benchmarkViewportEffects(int passes) {
+    return p->screen.benchmarkViewportEffects(std::max(passes, 1));
+}
+
 Scene *Graphics::getScreen() const { return &p->screen; }
 
 void Graphics::repaintWait(const AtomicFlag &exitCond, bool checkReset) {
     if (exitCond)
         return;
     
+    p->waitPresent();
+    
     /* Repaint the screen with the last good frame we drew */
     TEXFBO &lastFrame = p->screen.getPP().frontBuffer();
 
@@ -1785,7 +2395,10 @@ void Graphics::repaintWait(const AtomicFlag &exitCond, bool checkReset) {
         
         FBO::clear();
         p->metaBlitBufferFlippedScaled(scaleIsSpecial);
-        SDL_GL_SwapWindow(p->threadData->window);
+        
+        if (!p->headless)
+            SDL_GL_SwapWindow(p->threadData->window);
+        
         p->fpsLimiter.delay();
         
         p->threadData->ethread->notifyFrame();
@@ -25,6 +25,9 @@
 #include "util.h"
 #include "gl-util.h"
 
+#include <stdint.h>
+#include <vector>
+
 class Scene;
 class Bitmap;
 class Disposable;
@@ -33,6 +36,44 @@ struct GraphicsPrivate;
 struct AtomicFlag;
 struct THEORAPLAY_VideoFrame;
 struct Movie;
+struct FrameTiming;
+struct CaptureResult;
+
+/* Cost of one full screen viewport effect (gray, tone,
+ * color and flash) for either way of rendering it */
+struct ViewportEffectBenchmark
+{
+    /* Milliseconds per effect, including the GPU */
+    double fusedMs;
+    double multiPassMs;
+    
+    /* Pixels written per effect */
+    uint64_t fusedFill;
+    uint64_t multiPassFill;
+};
+
+/* Frame pacing over the most recent frames */
+struct FramePacingStats
+{
+    /* Frames covered */
+    int frames;
+    
+    /* Interval between frames, in ms (variance in ms^2) */
+    double meanMs;
+    double variance;
+    double minMs;
+    double maxMs;
+    
+    /* Frames finished more than 1 ms past their deadline,
+     * recently and since startup */
+    int missed;
+    uint64_t totalMissed;
+    
+    /* Precise pacing: time left to busy-wait after sleeping,
+     * and the average amount sleeps overshoot, in ms */
+    double spinMarginMs;
+    double oversleepMs;
+};
 
 class Graphics
 {
@@ -72,6 +113,11 @@ public:
 	bool updateMovieInput(Movie *movie);
 	void playMovie(const char *filename, int volume, bool skippable);
 	void screenshot(const char *filename);
+	
+	/* Saves the screen in the background and returns an id
+	 * for the capture, reported by finishedScreenshots() */
+	int screenshotAsync(const char *filename);
+	void finishedScreenshots(std::vector<CaptureResult> &out);
 
 	void reset();
     void center();
@@ -88,6 +134,14 @@ public:
     DECL_ATTR( LastMileScaling, bool )
     DECL_ATTR( Threadsafe, bool )
     double averageFrameRate();
+    
+    /* CPU timings of the most recent frames, oldest first */
+    void frameStats(std::vector<FrameTiming> &out) const;
+    
+    void pacingStats(FramePacingStats &out) const;
+    
+    /* Renders 'passes' viewport effects with each path */
+    ViewportEffectBenchmark benchmarkViewportEffects(int passes);
 
 	/* <internal> */
 	Scene *getScreen() const;
@@ -0,0 +1,538 @@
+/*
+** imageloader.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imageloader.h"
+
+#include "gifstream.h"
+#include "sharedstate.h"
+#include "filesystem.h"
+#include "glstate.h"
+#include "texpool.h"
+#include "config.h"
+#include "debugwriter.h"
+#include "sdl-util.h"
+
+extern "C" {
+#include "libnsgif/libnsgif.h"
+}
+
+#include <SDL_mutex.h>
+#include <SDL_surface.h>
+#include <SDL_timer.h>
+
+#include <algorithm>
+
+/* Textures held for images nobody picked up yet; past this,
+ * decoded surfaces are left for the Bitmap to upload */
+static const size_t maxUploadedBytes = 64 * 1024 * 1024;
+
+/* Rows are uploaded in chunks of about this many bytes,
+ * checking the time budget in between */
+static const int uploadChunkBytes = 256 * 1024;
+
+void DecodedImage::release()
+{
+	if (surface)
+		SDL_FreeSurface(surface);
+
+	if (gif)
+	{
+		gif_finalise(gif);
+		delete gif;
+		delete[] gifData;
+	}
+
+	if (tex.tex != TEX::ID(0))
+		shState->texPool().release(tex);
+
+	surface = 0;
+	gif = 0;
+	gifData = 0;
+	tex = TEXFBO();
+}
+
+static size_t textureBytesOf(const TEXFBO &tex)
+{
+	return (size_t) tex.width * tex.height * 4;
+}
+
+ImageLoader::ImageLoader(const Config &conf)
+    : threadCount(conf.imageDecodeThreads),
+      mutex(SDL_CreateMutex()),
+      jobCond(SDL_CreateCond()),
+      doneCond(SDL_CreateCond()),
+      quit(false),
+      uploadedBytes(0),
+      textureBytes(0),
+      textureBudget((size_t) std::max(conf.imageCacheSize, 0) * 1024)
+{}
+
+ImageLoader::~ImageLoader()
+{
+	SDL_LockMutex(mutex);
+	quit = true;
+	SDL_CondBroadcast(jobCond);
+	SDL_UnlockMutex(mutex);
+
+	for (size_t i = 0; i < workers.size(); ++i)
+		SDL_WaitThread(workers[i], 0);
+
+	/* The texture pool may already be gone at this point */
+	BoostHash<std::string, Entry*>::const_iterator iter;
+	for (iter = entries.cbegin(); iter != entries.cend(); ++iter)
+	{
+		DecodedImage &image = iter->second->image;
+
+		if (image.tex.tex != TEX::ID(0))
+			TEXFBO::fini(image.tex);
+
+		image.tex = TEXFBO();
+		image.release();
+
+		delete iter->second;
+	}
+
+	for (TextureList::iterator tIter = textures.begin(); tIter != textures.end(); ++tIter)
+		TEXFBO::fini(tIter->tex);
+
+	SDL_DestroyCond(doneCond);
+	SDL_DestroyCond(jobCond);
+	SDL_DestroyMutex(mutex);
+}
+
+void ImageLoader::preload(const std::string &path)
+{
+	if (threadCount <= 0)
+		return;
+
+	SDL_LockMutex(mutex);
+
+	if (!entries.contains(path))
+	{
+		Entry *entry = new Entry;
+		entry->state = Queued;
+		entry->dropped = false;
+
+		entries.insert(path, entry);
+		jobs.push_back(path);
+
+		if (workers.empty())
+			startWorkers();
+
+		SDL_CondSignal(jobCond);
+	}
+
+	SDL_UnlockMutex(mutex);
+}
+
+bool ImageLoader::take(const std::string &path, DecodedImage &out)
+{
+	SDL_LockMutex(mutex);
+
+	if (!entries.contains(path))
+	{
+		SDL_UnlockMutex(mutex);
+		return false;
+	}
+
+	Entry *entry = entries[path];
+	entries.remove(path);
+
+	/* Not started yet; the worker skips it once it's gone
+	 * from 'entries', and waiting on it would only be slower */
+	if (entry->state == Queued)
+	{
+		SDL_UnlockMutex(mutex);
+
+		delete entry;
+		decodeImage(path.c_str(), out);
+
+		return true;
+	}
+
+	while (entry->state != Decoded)
+		SDL_CondWait(doneCond, mutex);
+
+	SDL_UnlockMutex(mutex);
+
+	out = entry->image;
+	delete entry;
+
+	finishUpload(out);
+
+	return true;
+}
+
+void ImageLoader::update(int budgetUs)
+{
+	/* Drivers needing the fix can't be trusted with row uploads */
+	if (shState->config().subImageFix)
+		return;
+
+	const Uint64 start = SDL_GetPerformanceCounter();
+	const Uint64 budget = SDL_GetPerformanceFrequency() * budgetUs / 1000000;
+
+	/* Entries only leave the map on this thread, so
+	 * the pointers stay valid after unlocking */
+	std::vector<Entry*> pending;
+
+	SDL_LockMutex(mutex);
+
+	BoostHash<std::string, Entry*>::const_iterator iter;
+	for (iter = entries.cbegin(); iter != entries.cend(); ++iter)
+	{
+		Entry *entry = iter->second;
+		SDL_Surface *surf = entry->image.surface;
+
+		if (entry->state == Decoded && surf && entry->image.uploadedRows < surf->h)
+			pending.push_back(entry);
+	}
+
+	SDL_UnlockMutex(mutex);
+
+	for (size_t i = 0; i < pending.size(); ++i)
+	{
+		DecodedImage &image = pending[i]->image;
+		SDL_Surface *surf = image.surface;
+
+		if (image.tex.tex == TEX::ID(0))
+		{
+			/* Becomes a mega surface */
+			if (surf->w > glState.caps.maxTexSize || surf->h > glState.caps.maxTexSize)
+				continue;
+
+			const size_t bytes = (size_t) surf->w * surf->h * 4;
+
+			if (uploadedBytes + bytes > maxUploadedBytes)
+				continue;
+
+			try
+			{
+				image.tex = shState->texPool().request(surf->w, surf->h);
+			}
+			catch (const Exception &)
+			{
+				continue;
+			}
+
+			uploadedBytes += bytes;
+		}
+
+		const int chunkRows = std::max(1, uploadChunkBytes / surf->pitch);
+
+		while (uploadRows(image, chunkRows))
+			if (SDL_GetPerformanceCounter() - start >= budget)
+				return;
+	}
+}
+
+void ImageLoader::clear()
+{
+	SDL_LockMutex(mutex);
+
+	BoostHash<std::string, Entry*>::const_iterator iter;
+	for (iter = entries.cbegin(); iter != entries.cend(); ++iter)
+	{
+		Entry *entry = iter->second;
+
+		/* Freed by the worker when it's done */
+		if (entry->state == Decoding)
+		{
+			entry->dropped = true;
+			continue;
+		}
+
+		entry->image.release();
+		delete entry;
+	}
+
+	entries.clear();
+	jobs.clear();
+
+	SDL_UnlockMutex(mutex);
+
+	uploadedBytes = 0;
+}
+
+static std::string fileKey(const std::string &path)
+{
+	std::string source;
+	int64_t modtime;
+
+	shState->fileSystem().stat(path.c_str(), source, modtime);
+
+	/* A file replaced on disk or shadowed by a newly
+	 * mounted archive gets a different key */
+	return source + '\n' + path + '\n' + std::to_string(modtime);
+}
+
+template<typename C>
+static bool containsStream(const C &list, GifStream *stream)
+{
+	return std::find(list.begin(), list.end(), stream) != list.end();
+}
+
+template<typename C>
+static void removeStream(C &list, GifStream *stream)
+{
+	list.erase(std::remove(list.begin(), list.end(), stream), list.end());
+}
+
+void ImageLoader::decodeStream(GifStream *stream)
+{
+	if (threadCount <= 0)
+		return;
+
+	SDL_LockMutex(mutex);
+
+	/* Picked up again by the thread decoding it */
+	if (containsStream(streamsRunning, stream))
+	{
+		if (!containsStream(streamsRequeued, stream))
+			streamsRequeued.push_back(stream);
+	}
+	else if (!containsStream(streamJobs, stream))
+	{
+		streamJobs.push_back(stream);
+
+		if (workers.empty())
+			startWorkers();
+
+		SDL_CondSignal(jobCond);
+	}
+
+	SDL_UnlockMutex(mutex);
+}
+
+void ImageLoader::cancelStream(GifStream *stream)
+{
+	SDL_LockMutex(mutex);
+
+	while (containsStream(streamsRunning, stream))
+		SDL_CondWait(doneCond, mutex);
+
+	removeStream(streamJobs, stream);
+	removeStream(streamsRequeued, stream);
+
+	SDL_UnlockMutex(mutex);
+}
+
+std::string ImageLoader::textureKey(const char *filename)
+{
+	if (textureBudget == 0 || !loadedPaths.contains(filename))
+		return std::string();
+
+	return fileKey(loadedPaths[filename]);
+}
+
+std::string ImageLoader::recordTextureKey(const char *filename, const std::string &path)
+{
+	if (textureBudget == 0 || path.empty())
+		return std::string();
+
+	loadedPaths.insert(filename, path);
+
+	return fileKey(path);
+}
+
+bool ImageLoader::findTexture(const std::string &key, TEXFBO &tex)
+{
+	if (key.empty() || !textureIndex.contains(key))
+		return false;
+
+	TextureList::iterator iter = textureIndex[key];
+	textures.splice(textures.begin(), textures, iter);
+
+	tex = iter->tex;
+	shState->texPool().retain(tex);
+
+	return true;
+}
+
+void ImageLoader::cacheTexture(const std::string &key, const TEXFBO &tex)
+{
+	if (key.empty() || textureIndex.contains(key) || textureBytesOf(tex) > textureBudget)
+		return;
+
+	shState->texPool().retain(tex);
+
+	CachedTexture cached = { key, tex };
+	textures.push_front(cached);
+	textureIndex.insert(key, textures.begin());
+	textureBytes += textureBytesOf(tex);
+
+	evictTextures();
+}
+
+void ImageLoader::clearTextures()
+{
+	for (TextureList::iterator iter = textures.begin(); iter != textures.end(); ++iter)
+		shState->texPool().release(iter->tex);
+
+	textures.clear();
+	textureIndex.clear();
+	textureBytes = 0;
+}
+
+void ImageLoader::evictTextures()
+{
+	TextureList::iterator iter = textures.end();
+
+	while (textureBytes > textureBudget && iter != textures.begin())
+	{
+		--iter;
+
+		/* Still in use by a Bitmap; costs nothing extra */
+		if (shState->texPool().isShared(iter->tex))
+			continue;
+
+		textureBytes -= textureBytesOf(iter->tex);
+		shState->texPool().release(iter->tex);
+
+		textureIndex.remove(iter->key);
+		iter = textures.erase(iter);
+	}
+}
+
+void ImageLoader::startWorkers()
+{
+	for (int i = 0; i < threadCount; ++i)
+	{
+		SDL_Thread *thread = createSDLThread
+			<ImageLoader, &ImageLoader::workerLoop>(this, "imageloader");
+
+		if (!thread)
+		{
+			Debug() << "Failed to start an image decode thread:" << SDL_GetError();
+			break;
+		}
+
+		workers.push_back(thread);
+	}
+
+	/* Without any workers, take() decodes queued images itself */
+}
+
+void ImageLoader::finishUpload(DecodedImage &image)
+{
+	if (image.tex.tex == TEX::ID(0))
+		return;
+
+	uploadedBytes -= textureBytesOf(image.tex);
+
+	if (image.uploadedRows < image.surface->h)
+		uploadRows(image, image.surface->h - image.uploadedRows);
+}
+
+bool ImageLoader::uploadRows(DecodedImage &image, int rows)
+{
+	SDL_Surface *surf = image.surface;
+
+	rows = std::min(rows, surf->h - image.uploadedRows);
+
+	const uint8_t *pixels = (const uint8_t*) surf->pixels + image.uploadedRows * surf->pitch;
+
+	TEX::bind(image.tex.tex);
+	TEX::uploadSubImage(0, image.uploadedRows, surf->w, rows, pixels, GL_RGBA);
+
+	image.uploadedRows += rows;
+
+	return image.uploadedRows < surf->h;
+}
+
+void ImageLoader::runStreamJob()
+{
+	GifStream *stream = streamJobs.front();
+	streamJobs.pop_front();
+	streamsRunning.push_back(stream);
+
+	SDL_UnlockMutex(mutex);
+
+	bool more = stream->decodeNext();
+
+	SDL_LockMutex(mutex);
+
+	removeStream(streamsRunning, stream);
+
+	if (containsStream(streamsRequeued, stream))
+	{
+		removeStream(streamsRequeued, stream);
+		more = true;
+	}
+
+	/* To the back, so streams take turns */
+	if (more)
+		streamJobs.push_back(stream);
+
+	SDL_CondBroadcast(doneCond);
+}
+
+void ImageLoader::workerLoop()
+{
+	SDL_LockMutex(mutex);
+
+	while (true)
+	{
+		while (jobs.empty() && streamJobs.empty() && !quit)
+			SDL_CondWait(jobCond, mutex);
+
+		if (quit)
+			break;
+
+		/* Frames about to be shown come before
+		 * images that will be needed eventually */
+		if (!streamJobs.empty())
+		{
+			runStreamJob();
+			continue;
+		}
+
+		std::string path = jobs.front();
+		jobs.pop_front();
+
+		/* Taken or cleared in the meantime */
+		if (!entries.contains(path) || entries[path]->state != Queued)
+			continue;
+
+		Entry *entry = entries[path];
+		entry->state = Decoding;
+
+		SDL_UnlockMutex(mutex);
+
+		DecodedImage image;
+		decodeImage(path.c_str(), image);
+
+		SDL_LockMutex(mutex);
+
+		entry->image = image;
+		entry->state = Decoded;
+
+		if (entry->dropped)
+		{
+			entry->image.release();
+			delete entry;
+		}
+
+		SDL_CondBroadcast(doneCond);
+	}
+
+	SDL_UnlockMutex(mutex);
+}
@@ -0,0 +1,205 @@
+/*
+** imageloader.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include "gl-util.h"
+#include "exception.h"
+#include "boost-hash.h"
+
+#include <deque>
+#include <list>
+#include <string>
+#include <vector>
+
+struct SDL_Surface;
+struct SDL_Thread;
+struct SDL_mutex;
+struct SDL_cond;
+struct gif_animation;
+struct Config;
+class GifStream;
+
+struct DecodedImage
+{
+	/* Exactly one of these is set after a successful decode;
+	 * GIFs only have their first frame decoded */
+	SDL_Surface *surface;
+	gif_animation *gif;
+	unsigned char *gifData;
+	size_t gifDataSize;
+
+	/* Why neither is set */
+	std::string error;
+
+	/* File that was read, as found by FileSystem::openRead() */
+	std::string path;
+
+	/* Set if opening the file threw */
+	bool thrown;
+	Exception::Type excType;
+	std::string excMsg;
+
+	/* Texture 'surface' was uploaded to ahead of time, if any.
+	 * Valid once 'uploadedRows' reaches the surface height */
+	TEXFBO tex;
+	int uploadedRows;
+
+	DecodedImage()
+	    : surface(0), gif(0), gifData(0), gifDataSize(0),
+	      thrown(false), excType(Exception::MKXPError),
+	      uploadedRows(0)
+	{}
+
+	/* Frees whatever is still held */
+	void release();
+};
+
+/* Reads 'path' like Bitmap(const char*) does, converting the
+ * surface to ABGR8888. Lives in bitmap.cpp; safe to call from
+ * any thread */
+void decodeImage(const char *path, DecodedImage &out);
+
+/* Decodes image files on a pool of worker threads ahead of the
+ * Bitmaps that will be created from them. Finished surfaces are
+ * uploaded to pooled textures on the GL thread, a slice of rows
+ * per frame, so picking one up later costs next to nothing.
+ *
+ * Also keeps the textures of loaded files around, so Bitmaps
+ * created from the same file share one texture (until they're
+ * drawn to) instead of each decoding and uploading it again */
+class ImageLoader
+{
+public:
+	ImageLoader(const Config &conf);
+	~ImageLoader();
+
+	/* Queues 'path' unless it's already queued or decoded */
+	void preload(const std::string &path);
+
+	/* If 'path' was preloaded, waits for it to be decoded, moves
+	 * the result into 'out' and returns true. A queued job that
+	 * no worker picked up yet is decoded right here instead.
+	 * GL thread only, as it finishes any partial upload */
+	bool take(const std::string &path, DecodedImage &out);
+
+	/* Continues uploading decoded surfaces for up to 'budgetUs'
+	 * microseconds. Call once per frame, with the GL context
+	 * current */
+	void update(int budgetUs);
+
+	/* Drops all preloaded images; jobs in flight are
+	 * discarded once they finish */
+	void clear();
+
+	/* Has the decode threads call 'stream->decodeNext()' until
+	 * it runs out of frames to decode. Does nothing if there
+	 * are no decode threads */
+	void decodeStream(GifStream *stream);
+
+	/* Drops any decoding queued for 'stream' and waits for
+	 * the one in progress; call before destroying it */
+	void cancelStream(GifStream *stream);
+
+	/* Texture cache key of the file 'filename' was last loaded
+	 * from; empty if it wasn't loaded before or the cache is
+	 * disabled. GL thread only */
+	std::string textureKey(const char *filename);
+
+	/* Remembers that 'filename' was loaded from 'path' (see
+	 * DecodedImage) and returns that file's key */
+	std::string recordTextureKey(const char *filename, const std::string &path);
+
+	/* Returns false if 'key' isn't cached, otherwise fills 'tex'
+	 * with the cached texture, retained for the caller */
+	bool findTexture(const std::string &key, TEXFBO &tex);
+
+	/* Retains 'tex' for later findTexture() calls; it must not
+	 * be drawn to anymore unless it's unshared first */
+	void cacheTexture(const std::string &key, const TEXFBO &tex);
+
+	/* Releases all cached textures */
+	void clearTextures();
+
+private:
+	enum State
+	{
+		Queued,
+		Decoding,
+		Decoded
+	};
+
+	struct Entry
+	{
+		State state;
+		bool dropped;
+		DecodedImage image;
+	};
+
+	struct CachedTexture
+	{
+		std::string key;
+		TEXFBO tex;
+	};
+
+	typedef std::list<CachedTexture> TextureList;
+
+	void evictTextures();
+
+	void startWorkers();
+	void finishUpload(DecodedImage &image);
+	bool uploadRows(DecodedImage &image, int rows);
+
+	void runStreamJob();
+	void workerLoop();
+
+	int threadCount;
+
+	/* Shared with the workers */
+	std::vector<SDL_Thread*> workers;
+	SDL_mutex *mutex;
+	SDL_cond *jobCond;
+	SDL_cond *doneCond;
+	std::deque<std::string> jobs;
+	BoostHash<std::string, Entry*> entries;
+	bool quit;
+
+	/* Streams waiting for a thread, being decoded, and
+	 * asked for again while being decoded */
+	std::deque<GifStream*> streamJobs;
+	std::vector<GifStream*> streamsRunning;
+	std::vector<GifStream*> streamsRequeued;
+
+	/* GL thread only */
+	size_t uploadedBytes;
+
+	/* Requested file names to the files they were read from */
+	BoostHash<std::string, std::string> loadedPaths;
+
+	/* Most recently used first */
+	TextureList textures;
+	BoostHash<std::string, TextureList::iterator> textureIndex;
+	size_t textureBytes;
+	size_t textureBudget;
+};
+
+#endif // IMAGELOADER_H
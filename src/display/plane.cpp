@@ -22,6 +22,7 @@
 #include "plane.h"
 
 #include "sharedstate.h"
+#include "gpuprofiler.h"
 #include "bitmap.h"
 #include "etc.h"
 #include "util.h"
@@ -44,9 +45,12 @@ static float fwrap(float value, float range)
 
 struct PlanePrivate
 {
+	Plane *self;
+
 	Bitmap *bitmap;
 
 	sigslot::connection bitmapDispCon;
+	sigslot::connection bitmapModCon;
 
 	NormValue opacity;
 	BlendType blendType;
@@ -67,9 +71,12 @@ struct PlanePrivate
 
 	sigslot::connection prepareCon;
 	sigslot::connection srcRectCon;
+	sigslot::connection colorCon;
+	sigslot::connection toneCon;
 
-	PlanePrivate()
-	    : bitmap(0),
+	PlanePrivate(Plane *self)
+	    : self(self),
+	      bitmap(0),
 	      opacity(255),
 	      blendType(BlendNormal),
 	      color(&tmp.color),
@@ -80,6 +87,7 @@ struct PlanePrivate
 	      quadSourceDirty(false)
 	{
 		updateSrcRectCon();
+		updateColorToneCon();
 		prepareCon = shState->prepareDraw.connect
 		        (&PlanePrivate::prepare, this);
 
@@ -90,6 +98,8 @@ struct PlanePrivate
 	{
 		srcRectCon.disconnect();
 		prepareCon.disconnect();
+		colorCon.disconnect();
+		toneCon.disconnect();
 		
 		bitmapDisposal();
 	}
@@ -98,11 +108,19 @@ struct PlanePrivate
 	{
 		bitmap = 0;
 		bitmapDispCon.disconnect();
+		bitmapModCon.disconnect();
+	}
+
+	void onBitmapDisposed()
+	{
+		bitmapDisposal();
+		self->notifyContentChange();
 	}
 
 	void onSrcRectChange()
 	{
 		quadSourceDirty = true;
+		self->notifyContentChange();
 	}
 
 	void updateSrcRectCon()
@@ -111,6 +129,14 @@ struct PlanePrivate
 		srcRectCon = srcRect->valueChanged.connect(&PlanePrivate::onSrcRectChange, this);
 	}
 
+	void updateColorToneCon()
+	{
+		colorCon.disconnect();
+		toneCon.disconnect();
+		colorCon = color->valueChanged.connect(&SceneElement::notifyContentChange, self);
+		toneCon = tone->valueChanged.connect(&SceneElement::notifyContentChange, self);
+	}
+
 	void updateQuadSource()
 	{
 		if (nullOrDisposed(bitmap))
@@ -178,7 +204,7 @@ struct PlanePrivate
 Plane::Plane(Viewport *viewport)
     : ViewportElement(viewport)
 {
-	p = new PlanePrivate();
+	p = new PlanePrivate(this);
 
 	onGeometryChange(scene->getGeometry());
 }
@@ -190,7 +216,7 @@ DEF_ATTR_RD_SIMPLE(Plane, ZoomX,     float,   p->zoomX)
 DEF_ATTR_RD_SIMPLE(Plane, ZoomY,     float,   p->zoomY)
 DEF_ATTR_RD_SIMPLE(Plane, BlendType, int,     p->blendType)
 
-DEF_ATTR_SIMPLE(Plane, Opacity,   int,     p->opacity)
+DEF_ATTR_RD_SIMPLE(Plane, Opacity, int,   p->opacity)
 DEF_ATTR_SIMPLE(Plane, Color,     Color&, *p->color)
 DEF_ATTR_SIMPLE(Plane, Tone,      Tone&,  *p->tone)
 DEF_ATTR_SIMPLE(Plane, SrcRect,   Rect&,  *p->srcRect)
@@ -200,6 +226,14 @@ Plane::~Plane()
 	dispose();
 }
 
+void Plane::setOpacity(int value)
+{
+	guardDisposed();
+
+	p->opacity = value;
+	notifyContentChange();
+}
+
 void Plane::setBitmap(Bitmap *value)
 {
 	guardDisposed();
@@ -207,14 +241,17 @@ void Plane::setBitmap(Bitmap *value)
 	p->bitmap = value;
 
 	p->bitmapDispCon.disconnect();
+	p->bitmapModCon.disconnect();
 
 	if (nullOrDisposed(value))
 	{
 		p->bitmap = 0;
+		notifyContentChange();
 		return;
 	}
 
-	p->bitmapDispCon = value->wasDisposed.connect(&PlanePrivate::bitmapDisposal, p);
+	p->bitmapDispCon = value->wasDisposed.connect(&PlanePrivate::onBitmapDisposed, p);
+	p->bitmapModCon = value->modified.connect(&SceneElement::notifyContentChange, (SceneElement*) this);
 
 	value->ensureNonMega();
 
@@ -231,6 +268,7 @@ void Plane::setOX(int value)
 
 	p->ox = value;
 	p->quadSourceDirty = true;
+	notifyContentChange();
 }
 
 void Plane::setOY(int value)
@@ -242,6 +280,7 @@ void Plane::setOY(int value)
 
 	p->oy = value;
 	p->quadSourceDirty = true;
+	notifyContentChange();
 }
 
 void Plane::setZoomX(float value)
@@ -253,6 +292,7 @@ void Plane::setZoomX(float value)
 
 	p->zoomX = value;
 	p->quadSourceDirty = true;
+	notifyContentChange();
 }
 
 void Plane::setZoomY(float value)
@@ -264,12 +304,15 @@ void Plane::setZoomY(float value)
 
 	p->zoomY = value;
 	p->quadSourceDirty = true;
+	notifyContentChange();
 }
 
 void Plane::setBlendType(int value)
 {
 	guardDisposed();
 
+	notifyContentChange();
+
 	switch (value)
 	{
 	default :
@@ -292,6 +335,7 @@ void Plane::initDynAttribs()
 	p->srcRect = new Rect;
 
 	p->updateSrcRectCon();
+	p->updateColorToneCon();
 }
 
 void Plane::draw()
@@ -302,6 +346,8 @@ void Plane::draw()
 	if (!p->opacity)
 		return;
 
+	shState->gpuProfiler().setCategory(GPUProfiler::Planes);
+
 	ShaderBase *base;
 
 	if (p->color->hasEffect() || p->tone->hasEffect() || p->opacity != 255)
@@ -352,6 +398,17 @@ void Plane::onGeometryChange(const Scene::Geometry &geo)
 	p->quadSourceDirty = true;
 }
 
+bool Plane::blendsNormally()
+{
+	return p->blendType == BlendNormal;
+}
+
+bool Plane::tracksContentChanges()
+{
+	/* Animated bitmaps advance on their own */
+	return !(p->bitmap && p->bitmap->isAnimated());
+}
+
 void Plane::releaseResources()
 {
 	unlink();
@@ -54,6 +54,8 @@ private:
 	PlanePrivate *p;
 
 	void draw();
+	bool tracksContentChanges();
+	bool blendsNormally();
 	void onGeometryChange(const Scene::Geometry &);
 
 	void releaseResources();
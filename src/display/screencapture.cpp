@@ -0,0 +1,276 @@
+/*
+** screencapture.cpp
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "screencapture.h"
+
+#include "debugwriter.h"
+#include "gl-util.h"
+#include "sdl-util.h"
+
+#include <SDL_image.h>
+#include <SDL_mutex.h>
+#include <SDL_surface.h>
+
+#include <ctype.h>
+#include <string.h>
+
+/* Frames to wait before mapping a buffer without a fence */
+static const int readbackDelay = 2;
+
+/* How long to wait for each readback still in flight on exit */
+static const uint64_t exitWaitNs = 1000000000;
+
+bool saveSurfaceToFile(SDL_Surface *surf, const char *path)
+{
+	// Try and determine the intended image format from the filename extension
+	const char *period = strrchr(path, '.');
+	std::string ext;
+
+	if (period)
+		for (const char *c = period + 1; *c; ++c)
+			ext += tolower(*c);
+
+	int rc;
+
+	if (ext == "jpg" || ext == "jpeg")
+		rc = IMG_SaveJPG(surf, path, 90);
+	else if (ext == "png")
+		rc = IMG_SavePNG(surf, path);
+	else
+		rc = SDL_SaveBMP(surf, path);
+
+	return rc == 0;
+}
+
+ScreenCapture::ScreenCapture()
+    : nextId(1),
+      async(gl.pixel_pack_buffer && gl.MapBufferRange && gl.UnmapBuffer),
+      worker(0),
+      mutex(SDL_CreateMutex()),
+      cond(SDL_CreateCond()),
+      quit(false)
+{}
+
+ScreenCapture::~ScreenCapture()
+{
+	/* Captures requested in the last frames still get saved;
+	 * without a fence, mapping the buffer waits by itself */
+	for (size_t i = 0; i < readbacks.size(); ++i)
+	{
+		Readback &rb = readbacks[i];
+
+		if (rb.fence)
+			gl.ClientWaitSync(rb.fence, GL_SYNC_FLUSH_COMMANDS_BIT, exitWaitNs);
+
+		finishReadback(rb);
+	}
+
+	readbacks.clear();
+
+	if (worker)
+	{
+		/* Let the queued files finish writing */
+		SDL_LockMutex(mutex);
+		quit = true;
+		SDL_CondSignal(cond);
+		SDL_UnlockMutex(mutex);
+
+		SDL_WaitThread(worker, 0);
+	}
+
+	SDL_DestroyCond(cond);
+	SDL_DestroyMutex(mutex);
+}
+
+int ScreenCapture::request(const TEXFBO &source, const std::string &path)
+{
+	const int id = nextId++;
+
+	FBO::bind(source.fbo);
+
+	if (!async)
+	{
+		SDL_Surface *surf =
+			SDL_CreateRGBSurfaceWithFormat(0, source.width, source.height, 32, SDL_PIXELFORMAT_ABGR8888);
+
+		if (surf)
+			gl.ReadPixels(0, 0, source.width, source.height, GL_RGBA, GL_UNSIGNED_BYTE, surf->pixels);
+
+		queueJob(id, path, surf);
+
+		return id;
+	}
+
+	Readback rb;
+	rb.id = id;
+	rb.path = path;
+	rb.width = source.width;
+	rb.height = source.height;
+	rb.age = 0;
+
+	gl.GenBuffers(1, &rb.pbo);
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo);
+	gl.BufferData(GL_PIXEL_PACK_BUFFER, rb.width * rb.height * 4, 0, GL_STREAM_READ);
+
+	/* Returns immediately; the copy happens on the GPU */
+	gl.ReadPixels(0, 0, rb.width, rb.height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	rb.fence = gl.FenceSync ? gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : 0;
+
+	readbacks.push_back(rb);
+
+	return id;
+}
+
+void ScreenCapture::update()
+{
+	for (size_t i = 0; i < readbacks.size();)
+	{
+		Readback &rb = readbacks[i];
+
+		++rb.age;
+
+		if (!readbackReady(rb))
+		{
+			++i;
+			continue;
+		}
+
+		finishReadback(rb);
+		readbacks.erase(readbacks.begin() + i);
+	}
+}
+
+void ScreenCapture::takeFinished(std::vector<CaptureResult> &out)
+{
+	SDL_LockMutex(mutex);
+	out.insert(out.end(), finished.begin(), finished.end());
+	finished.clear();
+	SDL_UnlockMutex(mutex);
+}
+
+bool ScreenCapture::readbackReady(Readback &rb)
+{
+	if (!rb.fence)
+		return rb.age >= readbackDelay;
+
+	GLenum status = gl.ClientWaitSync(rb.fence, 0, 0);
+
+	return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void ScreenCapture::finishReadback(Readback &rb)
+{
+	const size_t size = rb.width * rb.height * 4;
+
+	SDL_Surface *surf =
+		SDL_CreateRGBSurfaceWithFormat(0, rb.width, rb.height, 32, SDL_PIXELFORMAT_ABGR8888);
+
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo);
+
+	void *data = gl.MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+
+	if (data && surf)
+		memcpy(surf->pixels, data, size);
+
+	if (data)
+		gl.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+	gl.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (rb.fence)
+		gl.DeleteSync(rb.fence);
+
+	gl.DeleteBuffers(1, &rb.pbo);
+
+	if (!data && surf)
+	{
+		SDL_FreeSurface(surf);
+		surf = 0;
+	}
+
+	queueJob(rb.id, rb.path, surf);
+}
+
+void ScreenCapture::queueJob(int id, const std::string &path, SDL_Surface *surf)
+{
+	Job job = { id, path, surf };
+
+	SDL_LockMutex(mutex);
+
+	if (!worker)
+		worker = createSDLThread
+			<ScreenCapture, &ScreenCapture::workerLoop>(this, "screencapture");
+
+	jobs.push_back(job);
+	SDL_CondSignal(cond);
+
+	SDL_UnlockMutex(mutex);
+
+	/* Do it here then */
+	if (!worker)
+	{
+		Debug() << "Failed to start the screen capture thread:" << SDL_GetError();
+
+		quit = true;
+		workerLoop();
+		quit = false;
+	}
+}
+
+void ScreenCapture::workerLoop()
+{
+	SDL_LockMutex(mutex);
+
+	while (true)
+	{
+		while (jobs.empty() && !quit)
+			SDL_CondWait(cond, mutex);
+
+		if (jobs.empty())
+			break;
+
+		Job job = jobs.front();
+		jobs.pop_front();
+
+		SDL_UnlockMutex(mutex);
+
+		bool ok = false;
+
+		if (job.surf)
+		{
+			ok = saveSurfaceToFile(job.surf, job.path.c_str());
+			SDL_FreeSurface(job.surf);
+		}
+
+		if (!ok)
+			Debug() << "Failed to save screenshot" << job.path << ":" << SDL_GetError();
+
+		SDL_LockMutex(mutex);
+
+		CaptureResult result = { job.id, ok };
+		finished.push_back(result);
+	}
+
+	SDL_UnlockMutex(mutex);
+}
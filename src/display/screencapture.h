@@ -0,0 +1,109 @@
+/*
+** screencapture.h
+**
+** This file is part of mkxp.
+**
+** Copyright (C) 2013 - 2021 Amaryllis Kulla <ancurio@mapleshrine.eu>
+**
+** mkxp is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 2 of the License, or
+** (at your option) any later version.
+**
+** mkxp is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with mkxp.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCREENCAPTURE_H
+#define SCREENCAPTURE_H
+
+#include "gl-fun.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+struct SDL_Surface;
+struct SDL_Thread;
+struct SDL_mutex;
+struct SDL_cond;
+struct TEXFBO;
+
+/* Saves 'surf' as PNG, JPG or BMP depending on the extension
+ * of 'path' (which must be normalized already). Returns false
+ * with the SDL error set on failure */
+bool saveSurfaceToFile(SDL_Surface *surf, const char *path);
+
+struct CaptureResult
+{
+	int id;
+	bool ok;
+};
+
+/* Saves framebuffer contents to files without stalling the game.
+ * The pixels are read back into a pixel pack buffer and mapped
+ * once its fence has signaled, usually a frame or two later;
+ * encoding and writing the file happen on a worker thread.
+ * Without pixel buffer objects (GLES 2) the readback itself is
+ * synchronous, but the rest still happens off the game thread. */
+class ScreenCapture
+{
+public:
+	ScreenCapture();
+	~ScreenCapture();
+
+	/* Starts reading back 'source' to be saved to 'path'
+	 * (normalized). Returns an id identifying the capture */
+	int request(const TEXFBO &source, const std::string &path);
+
+	/* Hands finished readbacks to the worker. Call once
+	 * per frame, with the GL context current */
+	void update();
+
+	/* Appends the captures done since the last call */
+	void takeFinished(std::vector<CaptureResult> &out);
+
+private:
+	struct Readback
+	{
+		int id;
+		std::string path;
+		int width, height;
+		GLuint pbo;
+		_GLsync fence;
+		int age;
+	};
+
+	struct Job
+	{
+		int id;
+		std::string path;
+		SDL_Surface *surf;
+	};
+
+	bool readbackReady(Readback &rb);
+	void finishReadback(Readback &rb);
+	void queueJob(int id, const std::string &path, SDL_Surface *surf);
+
+	void workerLoop();
+
+	/* GL thread only */
+	std::vector<Readback> readbacks;
+	int nextId;
+	bool async;
+
+	/* Shared with the worker */
+	SDL_Thread *worker;
+	SDL_mutex *mutex;
+	SDL_cond *cond;
+	std::deque<Job> jobs;
+	std::vector<CaptureResult> finished;
+	bool quit;
+};
+
+#endif // SCREENCAPTURE_H
@@ -22,6 +22,7 @@
 #include "sprite.h"
 
 #include "sharedstate.h"
+#include "gpuprofiler.h"
 #include "bitmap.h"
 #include "debugwriter.h"
 #include "config.h"
@@ -35,6 +36,7 @@
 #include "shader.h"
 #include "glstate.h"
 #include "quadarray.h"
+#include "spritebatch.h"
 
 #include <math.h>
 #ifndef M_PI
@@ -43,13 +45,19 @@
 
 #include <SDL_rect.h>
 
+#include <algorithm>
+#include <stdlib.h>
+
 #include "sigslot/signal.hpp"
 
 struct SpritePrivate
 {
+    Sprite *self;
+    
     Bitmap *bitmap;
     
     sigslot::connection bitmapDispCon;
+    sigslot::connection bitmapModCon;
     
     Quad quad;
     Transform trans;
@@ -65,6 +73,7 @@ struct SpritePrivate
     BlendType blendType;
     
     Bitmap *pattern;
+    sigslot::connection patternModCon;
     BlendType patternBlendType;
     bool patternTile;
     NormValue patternOpacity;
@@ -75,15 +84,21 @@ struct SpritePrivate
     
     bool invert;
     
+    /* Scene bounds in screen coordinates */
     IntRect sceneRect;
-    Vec2i sceneOrig;
     
     /* Would this sprite be visible on
      * the screen if drawn? */
     bool isVisible;
     
+    /* Does it have anything to draw at all,
+     * regardless of where it is? */
+    bool hasContent;
+    
     Color *color;
     Tone *tone;
+    sigslot::connection colorCon;
+    sigslot::connection toneCon;
     
     struct
     {
@@ -103,8 +118,9 @@ struct SpritePrivate
     
     sigslot::connection prepareCon;
     
-    SpritePrivate()
-    : bitmap(0),
+    SpritePrivate(Sprite *self)
+    : self(self),
+    bitmap(0),
     srcRect(&tmp.rect),
     mirrored(false),
     bushDepth(0),
@@ -118,13 +134,13 @@ struct SpritePrivate
     invert(false),
     obscured(false),
     isVisible(false),
+    hasContent(false),
     color(&tmp.color),
     tone(&tmp.tone)
     
     {
-        sceneRect.x = sceneRect.y = 0;
-        
         updateSrcRectCon();
+        updateColorToneCon();
         
         prepareCon = shState->prepareDraw.connect
         (&SpritePrivate::prepare, this);
@@ -143,6 +159,9 @@ struct SpritePrivate
     {
         srcRectCon.disconnect();
         prepareCon.disconnect();
+        colorCon.disconnect();
+        toneCon.disconnect();
+        patternModCon.disconnect();
         
         bitmapDisposal();
     }
@@ -151,6 +170,13 @@ struct SpritePrivate
     {
         bitmap = 0;
         bitmapDispCon.disconnect();
+        bitmapModCon.disconnect();
+    }
+    
+    void onBitmapDisposed()
+    {
+        bitmapDisposal();
+        self->notifyContentChange();
     }
 
     void recomputeBushDepth()
@@ -203,6 +229,8 @@ struct SpritePrivate
         recomputeBushDepth();
         
         wave.dirty = true;
+        
+        self->notifyContentChange();
     }
     
     void updateSrcRectCon()
@@ -214,9 +242,22 @@ struct SpritePrivate
         (&SpritePrivate::onSrcRectChange, this);
     }
     
+    void updateColorToneCon()
+    {
+        colorCon.disconnect();
+        toneCon.disconnect();
+        
+        /* Both are commonly changed in place */
+        colorCon = color->valueChanged.connect
+        (&SceneElement::notifyContentChange, self);
+        toneCon = tone->valueChanged.connect
+        (&SceneElement::notifyContentChange, self);
+    }
+    
     void updateVisibility()
     {
         isVisible = false;
+        hasContent = false;
         
         if (nullOrDisposed(bitmap))
             return;
@@ -224,29 +265,58 @@ struct SpritePrivate
         if (!opacity)
             return;
         
+        const Vec2 &size = quad.vert[2].pos;
+        
+        /* Empty src_rect */
+        if (size.x <= 0 || size.y <= 0)
+            return;
+        
+        hasContent = true;
+        
+        /* Compare a conservative bounding box of the transformed
+         * sprite quad against the scene */
+        float left = 0, right = size.x;
+        
+        /* Wave chunks are displaced by at most the amplitude */
         if (wave.active)
         {
-            /* Don't do expensive wave bounding box
-             * calculations */
-            isVisible = true;
-            return;
+            left -= abs(wave.amp);
+            right += abs(wave.amp);
         }
         
-        /* Compare sprite bounding box against the scene */
+        const Vec2 corners[] =
+        {
+            Vec2(left, 0), Vec2(right, 0),
+            Vec2(right, size.y), Vec2(left, size.y)
+        };
+        
+        const float *m = trans.getMatrix();
+        float minX, minY, maxX, maxY;
         
-        /* If sprite is zoomed/rotated, just opt out for now
-         * for simplicity's sake */
-        const Vec2 &scale = trans.getScale();
-        if (scale.x != 1 || scale.y != 1 || trans.getRotation() != 0)
+        for (int i = 0; i < 4; ++i)
         {
-            isVisible = true;
-            return;
+            float x = m[0] * corners[i].x + m[4] * corners[i].y + m[12];
+            float y = m[1] * corners[i].x + m[5] * corners[i].y + m[13];
+            
+            if (i == 0)
+            {
+                minX = maxX = x;
+                minY = maxY = y;
+                continue;
+            }
+            
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
         }
         
+        /* Pad by a pixel to stay on the safe side of rounding */
         IntRect self;
-        self.setPos(trans.getPositionI() - (trans.getOriginI() + sceneOrig));
-        self.w = bitmap->width();
-        self.h = bitmap->height();
+        self.x = (int) floorf(minX) - 1;
+        self.y = (int) floorf(minY) - 1;
+        self.w = (int) ceilf(maxX) - self.x + 1;
+        self.h = (int) ceilf(maxY) - self.y + 1;
         
         isVisible = SDL_HasIntersection(&self, &sceneRect);
     }
@@ -335,6 +405,44 @@ struct SpritePrivate
         wave.qArray.commit();
     }
     
+    /* Texture filter to draw with, depending on how much
+     * the sprite is scaled on screen */
+    int scalingMethod()
+    {
+        int sourceWidthHires = bitmap->hasHires() ? bitmap->getHires()->width() : bitmap->width();
+        int sourceHeightHires = bitmap->hasHires() ? bitmap->getHires()->height() : bitmap->height();
+
+        double framebufferScalingFactor = shState->config().enableHires ? shState->config().framebufferScalingFactor : 1.0;
+
+        int targetWidthHires = (int)lround(framebufferScalingFactor * bitmap->width() * trans.getScale().x);
+        int targetHeightHires = (int)lround(framebufferScalingFactor * bitmap->height() * trans.getScale().y);
+
+        int scaleIsSpecial = UpScale;
+
+        if (targetWidthHires == sourceWidthHires && targetHeightHires == sourceHeightHires)
+        {
+            scaleIsSpecial = SameScale;
+        }
+
+        if (targetWidthHires < sourceWidthHires && targetHeightHires < sourceHeightHires)
+        {
+            scaleIsSpecial = DownScale;
+        }
+
+        if (trans.getRotation() != 0.0)
+            return shState->config().bitmapSmoothScaling;
+
+        switch (scaleIsSpecial)
+        {
+        case SameScale:
+            return NearestNeighbor;
+        case DownScale:
+            return shState->config().bitmapSmoothScalingDown;
+        default:
+            return shState->config().bitmapSmoothScaling;
+        }
+    }
+    
     void prepare()
     {
         if (wave.dirty)
@@ -350,7 +458,7 @@ struct SpritePrivate
 Sprite::Sprite(Viewport *viewport)
 : ViewportElement(viewport)
 {
-    p = new SpritePrivate;
+    p = new SpritePrivate(this);
     onGeometryChange(scene->getGeometry());
 }
 
@@ -379,19 +487,32 @@ DEF_ATTR_RD_SIMPLE(Sprite, WaveLength, int,     p->wave.length)
 DEF_ATTR_RD_SIMPLE(Sprite, WaveSpeed,  int,     p->wave.speed)
 DEF_ATTR_RD_SIMPLE(Sprite, WavePhase,  float,   p->wave.phase)
 
-DEF_ATTR_SIMPLE(Sprite, BushOpacity, int,     p->bushOpacity)
-DEF_ATTR_SIMPLE(Sprite, Opacity,     int,     p->opacity)
+/* SrcRect, Color and Tone report changes through their
+ * valueChanged signals, everything else does so right here */
+#define DEF_ATTR_NOTIFY(klass, name, type, location) \
+DEF_ATTR_RD_SIMPLE(klass, name, type, location) \
+void klass :: set##name(type value) \
+{ \
+guardDisposed(); \
+location = value; \
+notifyContentChange(); \
+}
+
+DEF_ATTR_NOTIFY(Sprite, BushOpacity, int,     p->bushOpacity)
+DEF_ATTR_NOTIFY(Sprite, Opacity,     int,     p->opacity)
 DEF_ATTR_SIMPLE(Sprite, SrcRect,     Rect&,  *p->srcRect)
 DEF_ATTR_SIMPLE(Sprite, Color,       Color&, *p->color)
 DEF_ATTR_SIMPLE(Sprite, Tone,        Tone&,  *p->tone)
-DEF_ATTR_SIMPLE(Sprite, PatternTile, bool, p->patternTile)
-DEF_ATTR_SIMPLE(Sprite, PatternOpacity, int, p->patternOpacity)
-DEF_ATTR_SIMPLE(Sprite, PatternScrollX, int, p->patternScroll.x)
-DEF_ATTR_SIMPLE(Sprite, PatternScrollY, int, p->patternScroll.y)
-DEF_ATTR_SIMPLE(Sprite, PatternZoomX, float, p->patternZoom.x)
-DEF_ATTR_SIMPLE(Sprite, PatternZoomY, float, p->patternZoom.y)
-DEF_ATTR_SIMPLE(Sprite, Invert,      bool,    p->invert)
-DEF_ATTR_SIMPLE(Sprite, Obscured,    bool,    p->obscured)
+DEF_ATTR_NOTIFY(Sprite, PatternTile, bool, p->patternTile)
+DEF_ATTR_NOTIFY(Sprite, PatternOpacity, int, p->patternOpacity)
+DEF_ATTR_NOTIFY(Sprite, PatternScrollX, int, p->patternScroll.x)
+DEF_ATTR_NOTIFY(Sprite, PatternScrollY, int, p->patternScroll.y)
+DEF_ATTR_NOTIFY(Sprite, PatternZoomX, float, p->patternZoom.x)
+DEF_ATTR_NOTIFY(Sprite, PatternZoomY, float, p->patternZoom.y)
+DEF_ATTR_NOTIFY(Sprite, Invert,      bool,    p->invert)
+DEF_ATTR_NOTIFY(Sprite, Obscured,    bool,    p->obscured)
+
+#undef DEF_ATTR_NOTIFY
 
 void Sprite::setBitmap(Bitmap *bitmap)
 {
@@ -403,14 +524,17 @@ void Sprite::setBitmap(Bitmap *bitmap)
     p->bitmap = bitmap;
     
     p->bitmapDispCon.disconnect();
+    p->bitmapModCon.disconnect();
     
     if (nullOrDisposed(bitmap))
     {
         p->bitmap = 0;
+        notifyContentChange();
         return;
     }
     
-    p->bitmapDispCon = bitmap->wasDisposed.connect(&SpritePrivate::bitmapDisposal, p);
+    p->bitmapDispCon = bitmap->wasDisposed.connect(&SpritePrivate::onBitmapDisposed, p);
+    p->bitmapModCon = bitmap->modified.connect(&SceneElement::notifyContentChange, (SceneElement*) this);
     
     bitmap->ensureNonMega();
     
@@ -429,6 +553,7 @@ void Sprite::setX(int value)
         return;
     
     p->trans.setPosition(Vec2(value, getY()));
+    notifyContentChange();
 }
 
 void Sprite::setY(int value)
@@ -439,6 +564,7 @@ void Sprite::setY(int value)
         return;
     
     p->trans.setPosition(Vec2(getX(), value));
+    notifyContentChange();
     
     if (rgssVer >= 2)
     {
@@ -455,6 +581,7 @@ void Sprite::setOX(int value)
         return;
     
     p->trans.setOrigin(Vec2(value, getOY()));
+    notifyContentChange();
 }
 
 void Sprite::setOY(int value)
@@ -465,6 +592,7 @@ void Sprite::setOY(int value)
         return;
     
     p->trans.setOrigin(Vec2(getOX(), value));
+    notifyContentChange();
 }
 
 void Sprite::setZoomX(float value)
@@ -475,6 +603,7 @@ void Sprite::setZoomX(float value)
         return;
     
     p->trans.setScale(Vec2(value, getZoomY()));
+    notifyContentChange();
 }
 
 void Sprite::setZoomY(float value)
@@ -486,6 +615,7 @@ void Sprite::setZoomY(float value)
     
     p->trans.setScale(Vec2(getZoomX(), value));
     p->recomputeBushDepth();
+    notifyContentChange();
     
     if (rgssVer >= 2)
         p->wave.dirty = true;
@@ -499,6 +629,7 @@ void Sprite::setAngle(float value)
         return;
     
     p->trans.setRotation(value);
+    notifyContentChange();
 }
 
 void Sprite::setMirror(bool mirrored)
@@ -521,12 +652,15 @@ void Sprite::setBushDepth(int value)
     
     p->bushDepth = value;
     p->recomputeBushDepth();
+    notifyContentChange();
 }
 
 void Sprite::setBlendType(int type)
 {
     guardDisposed();
     
+    notifyContentChange();
+    
     switch (type)
     {
         default :
@@ -551,14 +685,23 @@ void Sprite::setPattern(Bitmap *value)
     
     p->pattern = value;
     
+    p->patternModCon.disconnect();
+    
     if (!nullOrDisposed(value))
+    {
         value->ensureNonMega();
+        p->patternModCon = value->modified.connect(&SceneElement::notifyContentChange, (SceneElement*) this);
+    }
+    
+    notifyContentChange();
 }
 
 void Sprite::setPatternBlendType(int type)
 {
     guardDisposed();
     
+    notifyContentChange();
+    
     switch (type)
     {
         default :
@@ -582,6 +725,7 @@ if (p->wave.name == value) \
 return; \
 p->wave.name = value; \
 p->wave.dirty = true; \
+notifyContentChange(); \
 }
 
 DEF_WAVE_SETTER(Amp,    amp,    int)
@@ -598,6 +742,7 @@ void Sprite::initDynAttribs()
     p->tone = new Tone;
     
     p->updateSrcRectCon();
+    p->updateColorToneCon();
 }
 
 /* Flashable */
@@ -605,10 +750,16 @@ void Sprite::update()
 {
     guardDisposed();
     
+    bool wasFlashing = flashing;
+    
     Flashable::update();
     
     p->wave.phase += p->wave.speed / 180;
     p->wave.dirty = true;
+    
+    /* The last flash frame has to be undone as well */
+    if (flashing || wasFlashing || p->wave.amp != 0)
+        notifyContentChange();
 }
 
 /* SceneElement */
@@ -620,6 +771,8 @@ void Sprite::draw()
     if (emptyFlashFlag)
         return;
     
+    shState->gpuProfiler().setCategory(GPUProfiler::Sprites);
+    
     ShaderBase *base;
     
     bool renderEffect = p->color->hasEffect() ||
@@ -629,44 +782,10 @@ void Sprite::draw()
     p->invert             ||
     (p->pattern && !p->pattern->isDisposed());
     
-    int scalingMethod = NearestNeighbor;
-
     int sourceWidthHires = p->bitmap->hasHires() ? p->bitmap->getHires()->width() : p->bitmap->width();
     int sourceHeightHires = p->bitmap->hasHires() ? p->bitmap->getHires()->height() : p->bitmap->height();
 
-    double framebufferScalingFactor = shState->config().enableHires ? shState->config().framebufferScalingFactor : 1.0;
-
-    int targetWidthHires = (int)lround(framebufferScalingFactor * p->bitmap->width() * p->trans.getScale().x);
-    int targetHeightHires = (int)lround(framebufferScalingFactor * p->bitmap->height() * p->trans.getScale().y);
-
-    int scaleIsSpecial = UpScale;
-
-    if (targetWidthHires == sourceWidthHires && targetHeightHires == sourceHeightHires)
-    {
-        scaleIsSpecial = SameScale;
-    }
-
-    if (targetWidthHires < sourceWidthHires && targetHeightHires < sourceHeightHires)
-    {
-        scaleIsSpecial = DownScale;
-    }
-
-    switch (scaleIsSpecial)
-    {
-    case SameScale:
-        scalingMethod = NearestNeighbor;
-        break;
-    case DownScale:
-        scalingMethod = shState->config().bitmapSmoothScalingDown;
-        break;
-    default:
-        scalingMethod = shState->config().bitmapSmoothScaling;
-    }
-
-    if (p->trans.getRotation() != 0.0)
-    {
-        scalingMethod = shState->config().bitmapSmoothScaling;
-    }
+    int scalingMethod = p->scalingMethod();
 
     if (p->obscured)
     {
@@ -818,14 +937,75 @@ void Sprite::draw()
     glState.blendMode.pop();
 }
 
+bool Sprite::isCulled()
+{
+    return p->hasContent && !p->isVisible;
+}
+
+bool Sprite::isEmpty()
+{
+    return !p->hasContent;
+}
+
+bool Sprite::drawBatched(SpriteBatch &batch)
+{
+    /* Nothing would be drawn either way */
+    if (emptyFlashFlag)
+        return true;
+    
+    if (p->obscured || p->wave.active || p->opacity != 255)
+        return false;
+    
+    if (p->color->hasEffect() || p->tone->hasEffect() || flashing ||
+        p->bushDepth != 0 || p->invert ||
+        (p->pattern && !p->pattern->isDisposed()))
+        return false;
+    
+    if (p->bitmap->hasHires() || p->scalingMethod() != NearestNeighbor)
+        return false;
+    
+    /* Apply the sprite matrix on the CPU so that differently
+     * transformed sprites can share one draw call */
+    const float *m = p->trans.getMatrix();
+    SVertex vert[4];
+    
+    for (int i = 0; i < 4; ++i)
+    {
+        const Vec2 &pos = p->quad.vert[i].pos;
+        
+        vert[i].pos = Vec2(m[0] * pos.x + m[4] * pos.y + m[12],
+                           m[1] * pos.x + m[5] * pos.y + m[13]);
+        vert[i].texPos = p->quad.vert[i].texPos;
+    }
+    
+    const TEXFBO &tex = p->bitmap->getGLTypes();
+    batch.append(tex.tex, Vec2i(tex.width, tex.height), p->blendType, vert);
+    
+    return true;
+}
+
 void Sprite::onGeometryChange(const Scene::Geometry &geo)
 {
     /* Offset at which the sprite will be drawn
      * relative to screen origin */
     p->trans.setGlobalOffset(geo.offset());
     
-    p->sceneRect.setSize(geo.rect.size());
-    p->sceneOrig = geo.orig;
+    p->sceneRect = geo.rect;
+}
+
+bool Sprite::blendsNormally()
+{
+    return p->blendType == BlendNormal;
+}
+
+bool Sprite::tracksContentChanges()
+{
+    /* Animated bitmaps advance on their own, and the
+     * obscured texture changes with the window's surroundings */
+    if (p->obscured)
+        return false;
+    
+    return !(p->bitmap && p->bitmap->isAnimated());
 }
 
 void Sprite::releaseResources()
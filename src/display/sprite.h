@@ -83,6 +83,11 @@ private:
 	SpritePrivate *p;
 
 	void draw();
+	bool drawBatched(SpriteBatch &batch);
+	bool isCulled();
+	bool isEmpty();
+	bool tracksContentChanges();
+	bool blendsNormally();
 	void onGeometryChange(const Scene::Geometry &);
 
 	void releaseResources();
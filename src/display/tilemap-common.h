@@ -184,7 +184,7 @@ struct FlashMap
 		shader.setAlpha(alpha);
 		shader.setTranslation(trans);
 
-		gl.DrawElements(GL_TRIANGLES, count * 6, _GL_INDEX_TYPE, 0);
+		GLMeta::drawQuads(vao, 0, count);
 
 		glState.blendMode.pop();
 
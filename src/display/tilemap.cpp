@@ -26,6 +26,7 @@
 #include "table.h"
 
 #include "sharedstate.h"
+#include "gpuprofiler.h"
 #include "config.h"
 #include "debugwriter.h"
 #include "glstate.h"
@@ -187,7 +188,8 @@ static elementsN(flashAlpha);
 
 struct GroundLayer : public ViewportElement
 {
-	GLsizei vboCount;
+	/* In quads */
+	size_t vboCount;
 	TilemapPrivate *p;
 
 	GroundLayer(TilemapPrivate *p, Viewport *viewport);
@@ -205,8 +207,9 @@ struct GroundLayer : public ViewportElement
 struct ZLayer : public ViewportElement
 {
 	size_t index;
-	GLintptr vboOffset;
-	GLsizei vboCount;
+	/* In quads */
+	size_t vboOffset;
+	size_t vboCount;
 	TilemapPrivate *p;
 
 	/* If this layer is part of a batch and not
@@ -214,8 +217,8 @@ struct ZLayer : public ViewportElement
 	bool batchedFlag;
 
 	/* If this layer is a batch head, this variable
-	 * holds the element count of the entire batch */
-	GLsizei vboBatchCount;
+	 * holds the quad count of the entire batch */
+	size_t vboBatchCount;
 
 	ZLayer(TilemapPrivate *p, Viewport *viewport);
 
@@ -227,7 +230,7 @@ struct ZLayer : public ViewportElement
 	static int calculateZ(TilemapPrivate *p, int index);
 
 	void initUpdateZ();
-	void finiUpdateZ(ZLayer *prev);
+	void finiUpdateZ();
 
 	ABOUT_TO_ACCESS_NOOP
 };
@@ -973,15 +976,8 @@ struct TilemapPrivate
 		for (size_t i = 0; i < elem.activeLayers; ++i)
 			elem.zlayers[i]->initUpdateZ();
 
-		ZLayer *prev = elem.zlayers[0];
-		prev->finiUpdateZ(0);
-
-		for (size_t i = 1; i < elem.activeLayers; ++i)
-		{
-			ZLayer *layer = elem.zlayers[i];
-			layer->finiUpdateZ(prev);
-			prev = layer;
-		}
+		for (size_t i = 0; i < elem.activeLayers; ++i)
+			elem.zlayers[i]->finiUpdateZ();
 	}
 
 	/* When there are two or more zlayers with no other
@@ -1002,7 +998,7 @@ struct TilemapPrivate
 			ZLayer *batchHead = zlayers[i];
 			batchHead->batchedFlag = false;
 
-			GLsizei vboBatchCount = batchHead->vboCount;
+			size_t vboBatchCount = batchHead->vboCount;
 			IntruListLink<SceneElement> *iter = &batchHead->link;
 
 			for (i = i+1; i < elem.activeLayers; ++i)
@@ -1101,7 +1097,7 @@ GroundLayer::GroundLayer(TilemapPrivate *p, Viewport *viewport)
 
 void GroundLayer::updateVboCount()
 {
-	vboCount = p->zlayerBases[0] * 6;
+	vboCount = p->zlayerBases[0];
 }
 
 void GroundLayer::draw()
@@ -1112,6 +1108,8 @@ void GroundLayer::draw()
 	if (!p->opacity)
 		return;
 
+	shState->gpuProfiler().setCategory(GPUProfiler::Tilemap);
+
 	ShaderBase *shader;
 
 	p->bindShader(shader);
@@ -1133,7 +1131,7 @@ void GroundLayer::draw()
 
 void GroundLayer::drawInt()
 {
-	gl.DrawElements(GL_TRIANGLES, vboCount, _GL_INDEX_TYPE, (GLvoid*) 0);
+	GLMeta::drawQuads(p->tiles.vao, 0, vboCount);
 }
 
 void GroundLayer::onGeometryChange(const Scene::Geometry &geo)
@@ -1157,8 +1155,8 @@ void ZLayer::setIndex(int value)
 	z = calculateZ(p, index);
 	scene->reinsert(*this);
 
-	vboOffset = p->zlayerBases[index] * sizeof(index_t) * 6;
-	vboCount = p->zlayerSize(index) * 6;
+	vboOffset = p->zlayerBases[index];
+	vboCount = p->zlayerSize(index);
 }
 
 void ZLayer::draw()
@@ -1166,6 +1164,8 @@ void ZLayer::draw()
 	if (batchedFlag)
 		return;
 
+	shState->gpuProfiler().setCategory(GPUProfiler::Tilemap);
+
 	ShaderBase *shader;
 
 	p->bindShader(shader);
@@ -1185,7 +1185,7 @@ void ZLayer::draw()
 
 void ZLayer::drawInt()
 {
-	gl.DrawElements(GL_TRIANGLES, vboBatchCount, _GL_INDEX_TYPE, (GLvoid*) vboOffset);
+	GLMeta::drawQuads(p->tiles.vao, vboOffset, vboBatchCount);
 }
 
 int ZLayer::calculateZ(TilemapPrivate *p, int index)
@@ -1198,14 +1198,10 @@ void ZLayer::initUpdateZ()
 	unlink();
 }
 
-void ZLayer::finiUpdateZ(ZLayer *prev)
+void ZLayer::finiUpdateZ()
 {
 	z = calculateZ(p, index);
-
-	if (prev)
-		scene->insertAfter(*this, *prev);
-	else
-		scene->insert(*this);
+	scene->insert(*this);
 }
 
 void Tilemap::Autotiles::set(int i, Bitmap *bitmap)
@@ -30,6 +30,7 @@
 #include "viewport.h"
 #include "gl-util.h"
 #include "sharedstate.h"
+#include "gpuprofiler.h"
 #include "glstate.h"
 #include "vertex.h"
 #include "quad.h"
@@ -38,6 +39,7 @@
 #include "tilemap-common.h"
 
 #include <vector>
+#include <algorithm>
 #include "sigslot/signal.hpp"
 
 /* Flash tiles pulsing opacity */
@@ -109,6 +111,7 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 
 		void draw()
 		{
+			shState->gpuProfiler().setCategory(GPUProfiler::Tilemap);
 			p->drawAbove();
 			p->drawFlashLayer();
 		}
@@ -268,11 +271,10 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 
 		VBO::bind(vbo);
 
-		if (totalQuads > allocQuads)
-		{
-			VBO::allocEmpty(quadBytes(totalQuads), GL_DYNAMIC_DRAW);
-			allocQuads = totalQuads;
-		}
+		/* Always respecify the storage so the upload
+		 * doesn't wait on draws still using the old data */
+		allocQuads = std::max(allocQuads, totalQuads);
+		VBO::allocEmpty(quadBytes(allocQuads), GL_DYNAMIC_DRAW);
 
 		VBO::uploadSubData(0, quadBytes(groundQuads), dataPtr(groundVert));
 		VBO::uploadSubData(quadBytes(groundQuads), quadBytes(aboveQuads), dataPtr(aboveVert));
@@ -319,6 +321,7 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 	/* SceneElement */
 	void draw()
 	{
+		shState->gpuProfiler().setCategory(GPUProfiler::Tilemap);
 		drawGround();
 		drawFlashLayer();
 	}
@@ -358,7 +361,7 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		}
 		GLMeta::vaoBind(vao);
 
-		gl.DrawElements(GL_TRIANGLES, groundQuads*6, _GL_INDEX_TYPE, 0);
+		GLMeta::drawQuads(vao, 0, groundQuads);
 
 		GLMeta::vaoUnbind(vao);
 	}
@@ -382,8 +385,7 @@ struct TilemapVXPrivate : public ViewportElement, TileAtlasVX::Reader
 		}
 		GLMeta::vaoBind(vao);
 
-		gl.DrawElements(GL_TRIANGLES, aboveQuads*6, _GL_INDEX_TYPE,
-		                (GLvoid*) (groundQuads*6*sizeof(index_t)));
+		GLMeta::drawQuads(vao, groundQuads, aboveQuads);
 
 		GLMeta::vaoUnbind(vao);
 	}
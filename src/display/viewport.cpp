@@ -27,6 +27,9 @@
 #include "quad.h"
 #include "glstate.h"
 #include "graphics.h"
+#include "texpool.h"
+#include "shader.h"
+#include "config.h"
 
 #include <SDL_rect.h>
 
@@ -42,10 +45,22 @@ struct ViewportPrivate
 
 	Color *color;
 	Tone *tone;
+	sigslot::connection colorCon;
+	sigslot::connection toneCon;
 
 	IntRect screenRect;
 	int isOnScreen;
 
+	/* Children composited into a screen sized texture,
+	 * reused until one of them changes */
+	struct
+	{
+		bool enabled;
+		bool dirty;
+		TEXFBO tex;
+		Quad quad;
+	} cache;
+
 	EtcTemps tmp;
 
 	ViewportPrivate(int x, int y, int width, int height, Viewport *self)
@@ -55,13 +70,20 @@ struct ViewportPrivate
 	      tone(&tmp.tone),
 	      isOnScreen(false)
 	{
+		cache.enabled = false;
+		cache.dirty = true;
+
 		rect->set(x, y, width, height);
 		updateRectCon();
+		updateColorToneCon();
 	}
 
 	~ViewportPrivate()
 	{
 		rectCon.disconnect();
+		colorCon.disconnect();
+		toneCon.disconnect();
+		releaseCache();
 	}
 
 	void onRectChange()
@@ -69,6 +91,13 @@ struct ViewportPrivate
 		self->geometry.rect = rect->toIntRect();
 		self->notifyGeometryChange();
 		recomputeOnScreen();
+		onContentChange();
+	}
+
+	void onContentChange()
+	{
+		cache.dirty = true;
+		self->notifyContentChange();
 	}
 
 	void updateRectCon()
@@ -78,6 +107,19 @@ struct ViewportPrivate
 		        (&ViewportPrivate::onRectChange, this);
 	}
 
+	void updateColorToneCon()
+	{
+		colorCon.disconnect();
+		toneCon.disconnect();
+
+		/* These only change how the composited children are
+		 * tinted, which the cache doesn't include */
+		colorCon = color->valueChanged.connect
+		        (&SceneElement::notifyContentChange, (SceneElement*) self);
+		toneCon = tone->valueChanged.connect
+		        (&SceneElement::notifyContentChange, (SceneElement*) self);
+	}
+
 	void recomputeOnScreen()
 	{
 		SDL_Rect r1 = { screenRect.x, screenRect.y,
@@ -97,6 +139,82 @@ struct ViewportPrivate
 
 		return (rectEffective && colorToneEffective && isOnScreen);
 	}
+
+	bool canUseCache()
+	{
+		if (!cache.enabled || rect->isEmpty())
+			return false;
+
+		/* Hires rendering scales the projection based on
+		 * whether the screen buffers are bound */
+		if (shState->config().enableHires)
+			return false;
+
+		/* Additive and subtractive children combine with what's
+		 * below the viewport, which the cache can't reproduce */
+		if (!self->normalBlendOnly())
+			return false;
+
+		/* Content we won't be told about must be redrawn anyway */
+		return self->contentChangesTracked();
+	}
+
+	void releaseCache()
+	{
+		if (cache.tex.tex == TEX::ID(0))
+			return;
+
+		shState->texPool().release(cache.tex);
+		TEXFBO::clear(cache.tex);
+	}
+
+	void renderCache()
+	{
+		const IntRect &screen = self->scene->getGeometry().rect;
+
+		if (cache.tex.width != screen.w || cache.tex.height != screen.h)
+		{
+			releaseCache();
+			cache.tex = shState->texPool().request(screen.w, screen.h);
+		}
+
+		/* Children are drawn exactly as they would be onto the
+		 * screen (same viewport, same scissor box), just into
+		 * our own transparent buffer */
+		FBO::ID screenFBO = FBO::boundFramebufferID;
+		FBO::bind(cache.tex.fbo);
+
+		glState.clearColor.pushSet(Vec4());
+		FBO::clear();
+		glState.clearColor.pop();
+
+		self->Scene::composite();
+
+		FBO::bind(screenFBO);
+
+		cache.dirty = false;
+	}
+
+	void drawCache()
+	{
+		/* Normal blending onto a cleared buffer leaves us with
+		 * premultiplied colors, which composite exactly like the
+		 * children did (canUseCache() rules out any others) */
+		SimpleShader &shader = shState->shaders().simple;
+		shader.bind();
+		shader.applyViewportProj();
+		shader.setTranslation(Vec2i());
+		shader.setTexSize(Vec2i(cache.tex.width, cache.tex.height));
+
+		TEX::bind(cache.tex.tex);
+
+		FloatRect r = rect->toFloatRect();
+		cache.quad.setTexPosRect(r, r);
+
+		glState.blendMode.pushSet(BlendPremultiplied);
+		cache.quad.draw();
+		glState.blendMode.pop();
+	}
 };
 
 Viewport::Viewport(int x, int y, int width, int height)
@@ -141,7 +259,12 @@ void Viewport::update()
 {
 	guardDisposed();
 
+	bool wasFlashing = flashing;
+
 	Flashable::update();
+
+	if (flashing || wasFlashing)
+		notifyContentChange();
 }
 
 DEF_ATTR_RD_SIMPLE(Viewport, OX,   int,   geometry.orig.x)
@@ -151,6 +274,8 @@ DEF_ATTR_SIMPLE(Viewport, Rect,  Rect&,  *p->rect)
 DEF_ATTR_SIMPLE(Viewport, Color, Color&, *p->color)
 DEF_ATTR_SIMPLE(Viewport, Tone,  Tone&,  *p->tone)
 
+DEF_ATTR_RD_SIMPLE(Viewport, Cache, bool, p->cache.enabled)
+
 void Viewport::setOX(int value)
 {
 	guardDisposed();
@@ -160,6 +285,7 @@ void Viewport::setOX(int value)
 
 	geometry.orig.x = value;
 	notifyGeometryChange();
+	p->onContentChange();
 }
 
 void Viewport::setOY(int value)
@@ -171,6 +297,21 @@ void Viewport::setOY(int value)
 
 	geometry.orig.y = value;
 	notifyGeometryChange();
+	p->onContentChange();
+}
+
+void Viewport::setCache(bool value)
+{
+	guardDisposed();
+
+	if (p->cache.enabled == value)
+		return;
+
+	p->cache.enabled = value;
+	p->onContentChange();
+
+	if (!value)
+		p->releaseCache();
 }
 
 void Viewport::initDynAttribs()
@@ -180,6 +321,7 @@ void Viewport::initDynAttribs()
 	p->tone = new Tone;
 
 	p->updateRectCon();
+	p->updateColorToneCon();
 }
 
 /* Scene */
@@ -197,7 +339,19 @@ void Viewport::composite()
 	glState.scissorTest.pushSet(true);
 	glState.scissorBox.pushSet(p->rect->toIntRect());
 
-	Scene::composite();
+	/* Color, tone and flash are applied on top of whatever we
+	 * drew, so they never go stale in the cache */
+	if (p->canUseCache())
+	{
+		if (p->cache.dirty)
+			p->renderCache();
+
+		p->drawCache();
+	}
+	else
+	{
+		Scene::composite();
+	}
 
 	/* If any effects are visible, request parent Scene to
 	 * render them. */
@@ -215,10 +369,28 @@ void Viewport::draw()
 	composite();
 }
 
+void Viewport::onContentChange()
+{
+	/* Children may unlink after we've been disposed */
+	if (p)
+		p->onContentChange();
+}
+
+bool Viewport::tracksContentChanges()
+{
+	return contentChangesTracked();
+}
+
+bool Viewport::isCulled()
+{
+	return !p->isOnScreen;
+}
+
 void Viewport::onGeometryChange(const Geometry &geo)
 {
 	p->screenRect = geo.rect;
 	p->recomputeOnScreen();
+	p->onContentChange();
 }
 
 void Viewport::releaseResources()
@@ -226,6 +398,7 @@ void Viewport::releaseResources()
 	unlink();
 
 	delete p;
+	p = 0;
 }
 
 
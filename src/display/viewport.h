@@ -44,6 +44,7 @@ public:
 	DECL_ATTR( OY,    int    )
 	DECL_ATTR( Color, Color& )
 	DECL_ATTR( Tone,  Tone&  )
+	DECL_ATTR( Cache, bool   )
 
 	void initDynAttribs();
 
@@ -52,7 +53,10 @@ private:
 	void geometryChanged();
 
 	void composite();
+	void onContentChange();
 	void draw();
+	bool isCulled();
+	bool tracksContentChanges();
 	void onGeometryChange(const Geometry &);
 	bool isEffectiveViewport(Rect *&, Color *&, Tone *&) const;
 
@@ -23,6 +23,7 @@
 
 #include "viewport.h"
 #include "sharedstate.h"
+#include "gpuprofiler.h"
 #include "bitmap.h"
 #include "etc.h"
 #include "etc-internal.h"
@@ -34,6 +35,8 @@
 #include "texpool.h"
 #include "glstate.h"
 
+#include <SDL_rect.h>
+
 #include "sigslot/signal.hpp"
 
 template<typename T>
@@ -174,6 +177,8 @@ struct WindowPrivate
 
 	sigslot::connection windowskinDispCon;
 	sigslot::connection contentsDispCon;
+	sigslot::connection windowskinModCon;
+	sigslot::connection contentsModCon;
 
 	bool bgStretch;
 	Rect *cursorRect;
@@ -183,6 +188,8 @@ struct WindowPrivate
 	sigslot::connection cursorRectCon;
 
 	Vec2i sceneOffset;
+	/* Scene bounds in screen coordinates */
+	IntRect sceneRect;
 
 	Vec2i position;
 	Vec2i size;
@@ -220,9 +227,20 @@ struct WindowPrivate
 
 		void draw()
 		{
+			shState->gpuProfiler().setCategory(GPUProfiler::Windows);
 			p->drawControls();
 		}
 
+		bool isCulled()
+		{
+			return p->isOffScreen();
+		}
+
+		bool tracksContentChanges()
+		{
+			return p->tracksContentChanges();
+		}
+
 		void release()
 		{
 			unlink();
@@ -294,17 +312,47 @@ struct WindowPrivate
 	{
 		windowskin = 0;
 		windowskinDispCon.disconnect();
+		windowskinModCon.disconnect();
 	}
 
 	void contentsDisposal()
 	{
 		contents = 0;
 		contentsDispCon.disconnect();
+		contentsModCon.disconnect();
+	}
+
+	void onWindowskinDisposed()
+	{
+		windowskinDisposal();
+		notifyContentChange();
+	}
+
+	void onContentsDisposed()
+	{
+		contentsDisposal();
+		notifyContentChange();
+	}
+
+	/* Base and controls always share a scene */
+	void notifyContentChange()
+	{
+		controlsElement.notifyContentChange();
+	}
+
+	bool tracksContentChanges()
+	{
+		/* Animated bitmaps advance on their own */
+		if (windowskin && windowskin->isAnimated())
+			return false;
+
+		return !(contents && contents->isAnimated());
 	}
 
 	void markControlVertDirty()
 	{
 		controlsVertDirty = true;
+		notifyContentChange();
 	}
 
 	void refreshCursorRectCon()
@@ -597,6 +645,13 @@ struct WindowPrivate
 		}
 	}
 
+	bool isOffScreen() const
+	{
+		const IntRect windowRect(position + sceneOffset, size);
+
+		return !SDL_HasIntersection(&windowRect, &sceneRect);
+	}
+
 	void drawControls()
 	{
 		if (nullOrDisposed(windowskin) && nullOrDisposed(contents))
@@ -654,7 +709,8 @@ struct WindowPrivate
 		glState.scissorTest.pop();
 	}
 
-	void updateControls()
+	/* Returns true if any animation frame changed */
+	bool updateControls()
 	{
 		bool updateArray = false;
 
@@ -680,6 +736,8 @@ struct WindowPrivate
 
 		if (updateArray)
 			controlsQuadArray.commit();
+
+		return updateArray;
 	}
 
 	void stepAnimations()
@@ -711,12 +769,14 @@ void Window::update()
 {
 	guardDisposed();
 
-	p->updateControls();
+	if (p->updateControls())
+		notifyContentChange();
+
 	p->stepAnimations();
 }
 
-DEF_ATTR_SIMPLE(Window, X,          int,     p->position.x)
-DEF_ATTR_SIMPLE(Window, Y,          int,     p->position.y)
+DEF_ATTR_RD_SIMPLE(Window, X,       int,     p->position.x)
+DEF_ATTR_RD_SIMPLE(Window, Y,       int,     p->position.y)
 DEF_ATTR_SIMPLE(Window, CursorRect, Rect&,  *p->cursorRect)
 
 DEF_ATTR_RD_SIMPLE(Window, Windowskin,      Bitmap*, p->windowskin)
@@ -732,6 +792,22 @@ DEF_ATTR_RD_SIMPLE(Window, Opacity,         int,     p->opacity)
 DEF_ATTR_RD_SIMPLE(Window, BackOpacity,     int,     p->backOpacity)
 DEF_ATTR_RD_SIMPLE(Window, ContentsOpacity, int,     p->contentsOpacity)
 
+void Window::setX(int value)
+{
+	guardDisposed();
+
+	p->position.x = value;
+	notifyContentChange();
+}
+
+void Window::setY(int value)
+{
+	guardDisposed();
+
+	p->position.y = value;
+	notifyContentChange();
+}
+
 void Window::setWindowskin(Bitmap *value)
 {
 	guardDisposed();
@@ -739,6 +815,9 @@ void Window::setWindowskin(Bitmap *value)
 	p->windowskin = value;
 
 	p->windowskinDispCon.disconnect();
+	p->windowskinModCon.disconnect();
+
+	notifyContentChange();
 
 	if (nullOrDisposed(value))
 	{
@@ -748,7 +827,8 @@ void Window::setWindowskin(Bitmap *value)
 
 	value->ensureNonMega();
 	
-	p->windowskinDispCon = value->wasDisposed.connect(&WindowPrivate::windowskinDisposal, p);
+	p->windowskinDispCon = value->wasDisposed.connect(&WindowPrivate::onWindowskinDisposed, p);
+	p->windowskinModCon = value->modified.connect(&WindowPrivate::notifyContentChange, p);
 }
 
 void Window::setContents(Bitmap *value)
@@ -762,6 +842,9 @@ void Window::setContents(Bitmap *value)
 	p->controlsVertDirty = true;
 
 	p->contentsDispCon.disconnect();
+	p->contentsModCon.disconnect();
+
+	notifyContentChange();
 
 	if (nullOrDisposed(value))
 	{
@@ -769,7 +852,8 @@ void Window::setContents(Bitmap *value)
 		return;
 	}
 
-	p->contentsDispCon = value->wasDisposed.connect(&WindowPrivate::contentsDisposal, p);
+	p->contentsDispCon = value->wasDisposed.connect(&WindowPrivate::onContentsDisposed, p);
+	p->contentsModCon = value->modified.connect(&WindowPrivate::notifyContentChange, p);
 
 	value->ensureNonMega();
 
@@ -785,6 +869,7 @@ void Window::setStretch(bool value)
 
 	p->bgStretch = value;
 	p->baseVertDirty = true;
+	notifyContentChange();
 }
 
 void Window::setActive(bool value)
@@ -796,6 +881,7 @@ void Window::setActive(bool value)
 
 	p->active = value;
 	p->cursorAniAlphaIdx = 0;
+	notifyContentChange();
 }
 
 void Window::setPause(bool value)
@@ -809,6 +895,7 @@ void Window::setPause(bool value)
 	p->pauseAniAlphaIdx = 0;
 	p->pauseAniQuadIdx = 0;
 	p->controlsVertDirty = true;
+	notifyContentChange();
 }
 
 void Window::setWidth(int value)
@@ -820,6 +907,7 @@ void Window::setWidth(int value)
 
 	p->size.x = value;
 	p->baseVertDirty = true;
+	notifyContentChange();
 }
 
 void Window::setHeight(int value)
@@ -831,6 +919,7 @@ void Window::setHeight(int value)
 
 	p->size.y = value;
 	p->baseVertDirty = true;
+	notifyContentChange();
 }
 
 void Window::setOX(int value)
@@ -842,6 +931,7 @@ void Window::setOX(int value)
 
 	p->contentsOffset.x = value;
 	p->controlsVertDirty = true;
+	notifyContentChange();
 }
 
 void Window::setOY(int value)
@@ -853,6 +943,7 @@ void Window::setOY(int value)
 
 	p->contentsOffset.y = value;
 	p->controlsVertDirty = true;
+	notifyContentChange();
 }
 
 void Window::setOpacity(int value)
@@ -864,6 +955,7 @@ void Window::setOpacity(int value)
 
 	p->opacity = value;
 	p->opacityDirty = true;
+	notifyContentChange();
 }
 
 void Window::setBackOpacity(int value)
@@ -875,6 +967,7 @@ void Window::setBackOpacity(int value)
 
 	p->backOpacity = value;
 	p->opacityDirty = true;
+	notifyContentChange();
 }
 
 void Window::setContentsOpacity(int value)
@@ -886,6 +979,7 @@ void Window::setContentsOpacity(int value)
 
 	p->contentsOpacity = value;
 	p->contentsQuad.setColor(Vec4(1, 1, 1, p->contentsOpacity.norm));
+	notifyContentChange();
 }
 
 void Window::initDynAttribs()
@@ -897,12 +991,19 @@ void Window::initDynAttribs()
 
 void Window::draw()
 {
+	shState->gpuProfiler().setCategory(GPUProfiler::Windows);
 	p->drawBase();
 }
 
+bool Window::isCulled()
+{
+	return p->isOffScreen();
+}
+
 void Window::onGeometryChange(const Scene::Geometry &geo)
 {
 	p->sceneOffset = geo.offset();
+	p->sceneRect = geo.rect;
 }
 
 void Window::setZ(int value)
@@ -924,6 +1025,11 @@ void Window::onViewportChange()
 	p->controlsElement.setScene(*this->scene);
 }
 
+bool Window::tracksContentChanges()
+{
+	return p->tracksContentChanges();
+}
+
 void Window::releaseResources()
 {
 	p->controlsElement.release();
@@ -62,6 +62,8 @@ private:
 	WindowPrivate *p;
 
 	void draw();
+	bool isCulled();
+	bool tracksContentChanges();
 	void onGeometryChange(const Scene::Geometry &);
 	void setZ(int value);
 	void setVisible(bool value);
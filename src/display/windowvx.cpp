@@ -27,11 +27,14 @@
 #include "quad.h"
 #include "quadarray.h"
 #include "sharedstate.h"
+#include "gpuprofiler.h"
 #include "texpool.h"
 #include "tilequad.h"
 #include "glstate.h"
 #include "shader.h"
 
+#include <SDL_rect.h>
+
 #include <limits>
 #include <algorithm>
 #include "sigslot/signal.hpp"
@@ -223,6 +226,8 @@ struct WindowVXPrivate
 	uint8_t cursorAlphaIdx;
 
 	Vec2i sceneOffset;
+	/* Scene bounds in screen coordinates */
+	IntRect sceneRect;
 
 	WindowVXPrivate(int x, int y, int w, int h)
 	    : windowskin(0),
@@ -740,6 +745,13 @@ struct WindowVXPrivate
 		}
 	}
 
+	bool isOffScreen() const
+	{
+		const IntRect windowRect(geo.pos() + sceneOffset, geo.size());
+
+		return !SDL_HasIntersection(&windowRect, &sceneRect);
+	}
+
 	void draw()
 	{
 		if (base.tex.tex == TEX::ID(0))
@@ -1133,12 +1145,19 @@ void WindowVX::initDynAttribs()
 
 void WindowVX::draw()
 {
+	shState->gpuProfiler().setCategory(GPUProfiler::Windows);
 	p->draw();
 }
 
+bool WindowVX::isCulled()
+{
+	return p->isOffScreen();
+}
+
 void WindowVX::onGeometryChange(const Scene::Geometry &geo)
 {
 	p->sceneOffset = geo.offset();
+	p->sceneRect = geo.rect;
 }
 
 void WindowVX::releaseResources()
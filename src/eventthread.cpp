@@ -32,9 +32,11 @@
 #include <alc.h>
 #include <alext.h>
 #include <cmath>
+#include <stdint.h>
 
 #include "sharedstate.h"
 #include "graphics.h"
+#include "gpuprofiler.h"
 
 #include "oneshot/oneshot.h"
 
@@ -591,8 +593,14 @@ void EventThread::process(RGSSThreadData &rtData)
                         if (!fps.sendUpdates)
                             break;
                         
-                        snprintf(buffer, sizeof(buffer), "%s - %d FPS",
-                                 rtData.config.windowTitle.c_str(), event.user.code);
+                        /* GPU frame time in microseconds, if measured */
+                        if (event.user.data1)
+                            snprintf(buffer, sizeof(buffer), "%s - %d FPS - GPU %.2f ms",
+                                     rtData.config.windowTitle.c_str(), event.user.code,
+                                     (intptr_t) event.user.data1 / 1000.0);
+                        else
+                            snprintf(buffer, sizeof(buffer), "%s - %d FPS",
+                                     rtData.config.windowTitle.c_str(), event.user.code);
                         
                         /* Updating the window title in fullscreen
                          * mode seems to cause flickering */
@@ -864,6 +872,7 @@ void EventThread::notifyFrame()
 #else
     event.user.code = round(shState->graphics().averageFrameRate());
 #endif
+    event.user.data1 = (void*) (intptr_t) lround(shState->gpuProfiler().averageTotal() * 1000);
     event.user.type = usrIdStart + UPDATE_FPS;
     SDL_PushEvent(&event);
 }
@@ -545,6 +545,9 @@ struct OpenReadEnumData {
   size_t matchCount;
   bool stopSearching;
 
+  /* Path of the file the handler accepted */
+  std::string *foundPath;
+
   /* In case of a PhysFS error, save it here so it
    * doesn't get changed before we get back into our code */
   const char *physfsError;
@@ -554,7 +557,7 @@ struct OpenReadEnumData {
                    BoostHash<std::string, std::string> *pathTrans)
       : handler(handler), filename(filename), filenameN(filenameN),
         pathTrans(pathTrans), matchCount(0), stopSearching(false),
-        physfsError(0) {}
+        foundPath(0), physfsError(0) {}
 };
 
 static PHYSFS_EnumerateCallbackResult
@@ -585,9 +588,14 @@ openReadEnumCB(void *d, const char *dirpath, const char *filename) {
     return PHYSFS_ENUM_OK;
 
   /* If the path cache is active, translate from lower case
-   * to mixed case path */
-  if (data.pathTrans)
-    fullPath = (*data.pathTrans)[fullPath].c_str();
+   * to mixed case path. Only look it up; decode threads
+   * search at the same time */
+  std::string transPath;
+
+  if (data.pathTrans) {
+    transPath = data.pathTrans->value(fullPath, fullPath);
+    fullPath = transPath.c_str();
+  }
 
   PHYSFS_File *phys = PHYSFS_openRead(fullPath);
 
@@ -604,14 +612,19 @@ openReadEnumCB(void *d, const char *dirpath, const char *filename) {
 
   const char *ext = findExt(filename);
 
-  if (data.handler.tryRead(data.ops, ext))
+  if (data.handler.tryRead(data.ops, ext)) {
     data.stopSearching = true;
 
+    if (data.foundPath)
+      *data.foundPath = fullPath;
+  }
+
   ++data.matchCount;
   return PHYSFS_ENUM_OK;
 }
 
-void FileSystem::openRead(OpenHandler &handler, const char *filename) {
+void FileSystem::openRead(OpenHandler &handler, const char *filename,
+                          std::string *foundPath) {
   std::string filename_nm = normalize(filename, false, false);
   char buffer[512];
   size_t len = strcpySafe(buffer, filename_nm.c_str(), sizeof(buffer), -1);
@@ -640,11 +653,15 @@ void FileSystem::openRead(OpenHandler &handler, const char *filename) {
   }
   OpenReadEnumData data(handler, file, len + buffer - delim - !root,
                         p->havePathCache ? &p->pathCache : 0);
+  data.foundPath = foundPath;
 
   if (p->havePathCache) {
     /* Get the list of files contained in this directory
-     * and manually iterate over them */
-    const std::vector<std::string> &fileList = p->fileLists[dir];
+     * and manually iterate over them. Don't insert unknown
+     * directories; images are opened from decode threads too */
+    static const std::vector<std::string> noFiles;
+    const std::vector<std::string> &fileList =
+        p->fileLists.contains(dir) ? p->fileLists[dir] : noFiles;
 
     for (size_t i = 0; i < fileList.size(); ++i)
       openReadEnumCB(&data, dir, fileList[i].c_str());
@@ -659,6 +676,15 @@ void FileSystem::openRead(OpenHandler &handler, const char *filename) {
     throw Exception(Exception::NoFileError, "%s", filename);
 }
 
+void FileSystem::stat(const char *path, std::string &source,
+                      int64_t &modtime) {
+  const char *realDir = PHYSFS_getRealDir(path);
+  source = realDir ? realDir : "";
+
+  PHYSFS_Stat stat;
+  modtime = PHYSFS_stat(path, &stat) ? stat.modtime : -1;
+}
+
 void FileSystem::openReadRaw(SDL_RWops &ops, const char *filename,
                              bool freeOnClose) {
 
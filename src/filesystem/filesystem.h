@@ -24,6 +24,7 @@
 
 #include <SDL_rwops.h>
 #include <string>
+#include <stdint.h>
 
 #include "filesystemImpl.h"
 
@@ -64,8 +65,16 @@ public:
 		virtual bool tryRead(SDL_RWops &ops, const char *ext) = 0;
 	};
 
+	/* 'foundPath' receives the path of the file
+	 * the handler accepted, if given */
 	void openRead(OpenHandler &handler,
-	              const char *filename);
+	              const char *filename,
+	              std::string *foundPath = 0);
+
+	/* Looks up the file at 'path', as returned through openRead()'s
+	 * 'foundPath'. 'source' is the directory or archive it's in,
+	 * 'modtime' its modification time (or -1) */
+	void stat(const char *path, std::string &source, int64_t &modtime);
 
 	/* Circumvents extension supplementing */
 	void openReadRaw(SDL_RWops &ops,
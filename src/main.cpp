@@ -224,8 +224,9 @@ int main(int argc, char *argv[]) {
     SDL_SetHint(SDL_HINT_OPENGL_ES_DRIVER, "1");
 #endif
 
-    /* initialize SDL first */
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER | SDL_INIT_TIMER) < 0) {
+    /* initialize SDL first; video waits for the config,
+     * which decides whether there's a display to use */
+    if (SDL_Init(SDL_INIT_GAMECONTROLLER | SDL_INIT_TIMER) < 0) {
       showInitError(std::string("Error initializing SDL: ") + SDL_GetError());
       return 0;
     }
@@ -254,6 +255,27 @@ int main(int argc, char *argv[]) {
     Config conf;
     conf.read(argc, argv);
 
+    /* Headless mode renders through SDL's offscreen driver,
+     * which uses a pbuffer/surfaceless EGL context and
+     * doesn't need a display server */
+    if (conf.headless)
+      SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0) {
+      showInitError(std::string(conf.headless ? "Error initializing headless video: "
+                                              : "Error initializing SDL video: ") + SDL_GetError());
+      return 0;
+    }
+
+    if (conf.headless) {
+      /* Don't go looking for an audio device either */
+      SDL_setenv("ALSOFT_DRIVERS", "null", 0);
+
+      conf.fullscreen = false;
+      conf.vsync = false;
+      conf.syncToRefreshrate = false;
+    }
+
 #if defined(__WIN32__)
     // Create a debug console in debug mode
     if (conf.winConsole) {
@@ -362,6 +384,8 @@ int main(int argc, char *argv[]) {
       winFlags |= SDL_WINDOW_RESIZABLE;
     if (conf.fullscreen)
       winFlags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
+    if (conf.headless)
+      winFlags |= SDL_WINDOW_HIDDEN;
     
 #ifdef GLES2_HEADER
   SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
@@ -581,7 +605,9 @@ static SDL_GLContext initGL(SDL_Window *win, Config &conf,
 
   gl.ClearColor(0, 0, 0, 1);
   gl.Clear(GL_COLOR_BUFFER_BIT);
-  SDL_GL_SwapWindow(win);
+
+  if (!conf.headless)
+    SDL_GL_SwapWindow(win);
 
   printGLInfo();
 
@@ -31,10 +31,16 @@
 #include "shader.h"
 #include "texpool.h"
 #include "font.h"
+#include "glyphatlas.h"
+#include "imageloader.h"
 #include "eventthread.h"
 #include "gl-util.h"
 #include "global-ibo.h"
+#include "vertexstream.h"
 #include "quad.h"
+#include "spritebatch.h"
+#include "gpuprofiler.h"
+#include "scene.h"
 #include "binding.h"
 #include "exception.h"
 #include "sharedmidistate.h"
@@ -51,6 +57,7 @@
 SharedState *SharedState::instance = 0;
 int SharedState::rgssVersion = 0;
 static GlobalIBO *_globalIBO = 0;
+static VertexStream *_vertexStream = 0;
 
 static const char *gameArchExt()
 {
@@ -98,6 +105,9 @@ struct SharedStatePrivate
 	SharedFontState fontState;
 	Font *defaultFont;
 
+	GlyphAtlas glyphAtlas;
+	ImageLoader imageLoader;
+
 	TEX::ID globalTex;
 	int globalTexW, globalTexH;
 	bool globalTexDirty;
@@ -108,6 +118,10 @@ struct SharedStatePrivate
 
 	Quad gpQuad;
 
+	SpriteBatch spriteBatch;
+	GPUProfiler gpuProfiler;
+	SceneStats sceneStats;
+
 	unsigned int stampCounter;
     
     std::chrono::time_point<std::chrono::steady_clock> startupTime;
@@ -126,6 +140,7 @@ struct SharedStatePrivate
 	      oneshot(*threadData),
 	      _glState(threadData->config),
 	      fontState(threadData->config),
+	      imageLoader(threadData->config),
 	      stampCounter(0)
 	{}
 	
@@ -134,10 +149,6 @@ struct SharedStatePrivate
         
         startupTime = std::chrono::steady_clock::now();
         
-		/* Shaders have been compiled in ShaderSet's constructor */
-		if (gl.ReleaseShaderCompiler)
-			gl.ReleaseShaderCompiler();
-
 		std::string archPath = config.execName + gameArchExt();
 
 		for (size_t i = 0; i < config.patches.size(); ++i)
@@ -203,12 +214,17 @@ void SharedState::initInstance(RGSSThreadData *threadData)
 	_globalIBO = new GlobalIBO();
 	_globalIBO->ensureSize(1);
 
+	_vertexStream = new VertexStream();
+
+	Shader::initBinaryCache(threadData->config);
+
 	SharedState::instance = 0;
 	Font *defaultFont = 0;
 
 	try
 	{
 		SharedState::instance = new SharedState(threadData);
+		Shader::saveBinaryCache();
 		Font::initDefaults(instance->p->fontState);
 		defaultFont = new Font();
 	}
@@ -217,6 +233,7 @@ void SharedState::initInstance(RGSSThreadData *threadData)
 		delete _globalIBO;
 		delete SharedState::instance;
 		delete defaultFont;
+		delete _vertexStream;
 
 		throw exc;
 	}
@@ -226,10 +243,14 @@ void SharedState::initInstance(RGSSThreadData *threadData)
 
 void SharedState::finiInstance()
 {
+	/* Keep whatever was compiled lazily during this run */
+	Shader::saveBinaryCache();
+
 	delete SharedState::instance->p->defaultFont;
 
 	delete SharedState::instance;
 
+	delete _vertexStream;
 	delete _globalIBO;
 }
 
@@ -262,7 +283,12 @@ GSATT(GLState&, _glState)
 GSATT(ShaderSet&, shaders)
 GSATT(TexPool&, texPool)
 GSATT(Quad&, gpQuad)
+GSATT(SpriteBatch&, spriteBatch)
+GSATT(GPUProfiler&, gpuProfiler)
+GSATT(SceneStats&, sceneStats)
 GSATT(SharedFontState&, fontState)
+GSATT(GlyphAtlas&, glyphAtlas)
+GSATT(ImageLoader&, imageLoader)
 GSATT(SharedMidiState&, midiState)
 
 void SharedState::setBindingData(void *data)
@@ -280,6 +306,11 @@ GlobalIBO &SharedState::globalIBO()
 	return *_globalIBO;
 }
 
+VertexStream &SharedState::vertexStream()
+{
+	return *_vertexStream;
+}
+
 void SharedState::bindTex()
 {
 	TEX::bind(p->globalTex);
@@ -35,6 +35,10 @@ struct SDL_Window;
 struct TEXFBO;
 struct Quad;
 struct ShaderSet;
+class SpriteBatch;
+class GPUProfiler;
+class VertexStream;
+struct SceneStats;
 
 class Scene;
 class FileSystem;
@@ -50,6 +54,8 @@ class GLState;
 class TexPool;
 class Font;
 class SharedFontState;
+class GlyphAtlas;
+class ImageLoader;
 struct GlobalIBO;
 struct Config;
 struct Vec2i;
@@ -88,6 +94,8 @@ struct SharedState
 	TexPool &texPool() const;
 
 	SharedFontState &fontState() const;
+	GlyphAtlas &glyphAtlas() const;
+	ImageLoader &imageLoader() const;
 	Font &defaultFont() const;
 	SharedMidiState &midiState() const;
 
@@ -102,6 +110,7 @@ struct SharedState
 	 * for at least minSize quads */
 	void ensureQuadIBO(size_t minSize);
 	GlobalIBO &globalIBO();
+	VertexStream &vertexStream();
 
 	/* Global general purpose texture */
 	void bindTex();
@@ -111,6 +120,13 @@ struct SharedState
 
 	Quad &gpQuad() const;
 
+	/* Shared by all scenes to merge consecutive sprite draws */
+	SpriteBatch &spriteBatch() const;
+	GPUProfiler &gpuProfiler() const;
+
+	/* Reset by the screen at the start of every composite */
+	SceneStats &sceneStats() const;
+
 	/* Basically just a simple "TexPool"
 	 * replacement for Tilemap atlas use */
 	void requestAtlasTex(int w, int h, TEXFBO &out);